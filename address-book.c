@@ -0,0 +1,1090 @@
+/*
+Motore nativo per address-book.sh: stessi comandi (view, search, insert, delete) su una rubrica
+indicizzata, invece di scandire o riscrivere tutto il file .csv a ogni operazione.
+
+La rubrica è nella directory address-book.db:
+    CURRENT       numero della generazione corrente N
+    header        intestazione del .csv (name,surname,phone,mail,city,address)
+    gen-N.dat     record in ordine di inserimento: RecHeader seguito dalla riga .csv. Una
+                  cancellazione segna il record come cancellato (tombstone) senza spostare nulla
+    gen-N.idx     tabella hash ad indirizzamento aperto sulla mail, mappata con mmap: controllo dei
+                  duplicati e cancellazione in O(1)
+    gen-N.ord     posizioni dei record ordinati per mail, per view
+    gen-N.tri     indice dei trigrammi (in minuscolo) di ogni riga, per search senza distinguere
+                  maiuscole e minuscole
+    lock          file su cui si prende flock: condiviso per leggere, esclusivo per modificare
+    compact.lock  tenuto dal processo che sta per compattare, perché ne parta uno solo alla volta
+.ord e .tri coprono i record presenti all'ultima compattazione; quelli inseriti dopo (la coda di
+.dat) vengono ordinati al momento da view e letti per intero da search. Quando la coda o i
+tombstone crescono troppo, un processo figlio in background compatta la rubrica in una nuova
+generazione: riscrive i record vivi, ricostruisce gli indici e rende corrente la generazione
+rinominando CURRENT.
+Un inserimento rende duraturo il record in .dat prima della sua cella in .idx, e una
+cancellazione il tombstone prima di liberare la cella. L'intestazione di .idx ricorda fin dove
+.dat è coperto da celle su disco: l'apertura in scrittura reinserisce i record successivi, rimasti
+senza cella per un crash.
+
+Comandi:
+    address-book view               stampa intestazione e righe ordinate per mail, in .csv
+    address-book search <stringa>   stampa le voci che contengono <stringa>
+    address-book insert             chiede i campi e inserisce la voce
+    address-book delete <mail>      cancella la voce con quella mail
+    address-book import <file.csv>  sostituisce la rubrica con il contenuto del .csv
+    address-book export <file.csv>  scrive la rubrica in formato .csv
+    address-book compact            compatta subito, in primo piano
+Se address-book.db non esiste ma esiste address-book-database.csv, il primo comando lo importa.
+
+Compilazione: gcc -O2 address-book.c -o address-book
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define DB_DIR "address-book.db"
+#define CSV_FILE "address-book-database.csv"
+#define DEFAULT_HEADER "name,surname,phone,mail,city,address"
+#define REC_DELETED 1               // RecHeader.flags: record cancellato
+#define SLOT_DELETED UINT64_MAX     // Slot.off di una cella cancellata
+#define MIN_TAIL 4096               // Record in coda oltre i quali si può compattare
+#define MIN_TOMBSTONES 1024         // Tombstone oltre i quali si può compattare
+#define MAX_RECORD 4096             // Lunghezza massima di una voce inserita
+
+// Intestazione di un record in .dat, seguita da len byte di riga .csv (senza '\n')
+typedef struct {
+    uint32_t len;
+    uint32_t flags;
+} RecHeader;
+
+// Intestazione di .idx, seguita da cap celle
+typedef struct {
+    char magic[8];
+    uint64_t cap;       // Celle, potenza di due
+    uint64_t used;      // Celle occupate, comprese quelle cancellate
+    uint64_t live;      // Voci presenti
+    uint64_t records;   // Record in .dat, compresi i cancellati
+    uint64_t covered;   // Lunghezza di .dat con le celle già su disco: i record oltre vengono reinseriti
+} IdxHeader;
+
+// Cella di .idx: off è la posizione del record in .dat più uno, 0 se la cella è vuota
+typedef struct {
+    uint64_t hash;
+    uint64_t off;
+} Slot;
+
+// Intestazione di .ord, seguita da count posizioni di record
+typedef struct {
+    char magic[8];
+    uint64_t count;
+    uint64_t covered;   // Lunghezza di .dat coperta da .ord e .tri: dopo inizia la coda
+} OrdHeader;
+
+// Intestazione di .tri, seguita da count TriEntry ordinate per trigramma e dagli elenchi delle
+// posizioni dei record, crescenti e codificati come differenze in varint
+typedef struct {
+    char magic[8];
+    uint64_t count;
+} TriHeader;
+
+typedef struct {
+    uint32_t trigram;   // Tre byte in minuscolo
+    uint32_t pad;
+    uint64_t first;     // Inizio dell'elenco, in byte dalla fine delle TriEntry
+    uint64_t count;
+} TriEntry;
+
+// Rubrica aperta
+typedef struct {
+    int gen;
+    int dat_fd;
+    char *dat;              // .dat mappato in lettura (fino a dat_size)
+    size_t dat_size;
+    int idx_fd;
+    IdxHeader *idx;         // .idx mappato in lettura e scrittura
+    Slot *slots;
+    OrdHeader *ord;
+    uint64_t *ord_offs;
+    size_t ord_size;
+    TriHeader *tri;
+    TriEntry *tri_entries;
+    const unsigned char *tri_postings;
+    size_t tri_size;
+    char header[256];
+} Db;
+
+// Riga da scrivere in una nuova generazione
+typedef struct {
+    const char *data;
+    uint32_t len;
+} Line;
+
+int lock_fd = -1;
+
+void die(const char *msg) {
+    perror(msg);
+    exit(EXIT_FAILURE);
+}
+
+void *xmalloc(size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (p == NULL) die("malloc");
+    return p;
+}
+
+// Percorso di un file della generazione gen
+void gen_path(char *buf, size_t size, int gen, const char *ext) {
+    snprintf(buf, size, DB_DIR "/gen-%d.%s", gen, ext);
+}
+
+uint64_t hash_mail(const char *mail, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)mail[i]) * 1099511628211ULL;
+    return h;
+}
+
+// Funzione per trovare il campo n (da 0) di una riga .csv; l'ultimo campo arriva a fine riga
+const char *csv_field(const char *line, size_t len, int n, size_t *field_len) {
+    const char *p = line, *end = line + len;
+    for (int i = 0; i < n; i++) {
+        const char *comma = memchr(p, ',', end - p);
+        if (comma == NULL) {
+            *field_len = 0;
+            return end;
+        }
+        p = comma + 1;
+    }
+    const char *comma = n < 5 ? memchr(p, ',', end - p) : NULL;
+    *field_len = (comma ? comma : end) - p;
+    return p;
+}
+
+// Record alla posizione off di .dat
+RecHeader *record_at(const Db *db, uint64_t off) {
+    return (RecHeader *)(db->dat + off);
+}
+
+const char *record_line(const Db *db, uint64_t off) {
+    return db->dat + off + sizeof(RecHeader);
+}
+
+// Funzione per scrivere tutto il buffer, ripetendo write se necessario
+void write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            die("write");
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+// Funzione per mappare in sola lettura un intero file; ritorna NULL se è vuoto o non esiste
+void *map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == -1) die(path);
+    *size = st.st_size;
+    void *p = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : NULL;
+    close(fd);
+    if (p == MAP_FAILED) die(path);
+    return p;
+}
+
+/*
+ * Generazioni
+ */
+
+// Sort key di view: come sort -t, -k4, dalla mail a fine riga, confrontata byte per byte
+const char *sort_key(const char *line, size_t len, size_t *key_len) {
+    const char *key = csv_field(line, len, 3, key_len);
+    *key_len = line + len - key;
+    return key;
+}
+
+int compare_keys(const char *a, size_t alen, const char *b, size_t blen) {
+    int cmp = memcmp(a, b, alen < blen ? alen : blen);
+    return cmp != 0 ? cmp : (alen > blen) - (alen < blen);
+}
+
+const Line *sort_lines;  // Righe confrontate da compare_line_index (qsort non ha un argomento utente)
+
+int compare_line_index(const void *a, const void *b) {
+    const Line *la = &sort_lines[*(const uint32_t *)a], *lb = &sort_lines[*(const uint32_t *)b];
+    size_t ka_len, kb_len;
+    const char *ka = sort_key(la->data, la->len, &ka_len), *kb = sort_key(lb->data, lb->len, &kb_len);
+    return compare_keys(ka, ka_len, kb, kb_len);
+}
+
+// Funzione per scrivere un file nuovo, renderlo duraturo e dargli il nome definitivo
+void write_file(const char *path, const void *parts[], const size_t sizes[], int nparts) {
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) die(tmp);
+    for (int i = 0; i < nparts; i++) write_all(fd, parts[i], sizes[i]);
+    if (fsync(fd) == -1 || close(fd) == -1 || rename(tmp, path) == -1) die(path);
+}
+
+// Numero di celle per n voci: tabella piena al più per metà
+uint64_t idx_capacity(uint64_t n) {
+    uint64_t cap = 1024;
+    while (cap < n * 2) cap *= 2;
+    return cap;
+}
+
+// Trigramma (in minuscolo) che inizia in p
+uint32_t trigram_at(const char *p) {
+    return (uint32_t)tolower((unsigned char)p[0]) << 16 | (uint32_t)tolower((unsigned char)p[1]) << 8 |
+           (uint32_t)tolower((unsigned char)p[2]);
+}
+
+int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Funzione per trovare i trigrammi distinti di una riga, in ordine crescente: li raccolgo tutti,
+// li ordino e tolgo i ripetuti. seen deve avere posto per len elementi
+int line_trigrams(const Line *l, uint32_t *seen) {
+    if (l->len < 3) return 0;
+    uint32_t n = l->len - 2;
+    for (uint32_t i = 0; i < n; i++) seen[i] = trigram_at(l->data + i);
+    qsort(seen, n, sizeof(uint32_t), compare_u32);
+    int nseen = 1;
+    for (uint32_t i = 1; i < n; i++) {
+        if (seen[i] != seen[nseen - 1]) seen[nseen++] = seen[i];
+    }
+    return nseen;
+}
+
+// Scrivo v in formato varint (7 bit per byte, il bit alto indica che segue un altro byte)
+size_t put_varint(unsigned char *p, uint64_t v) {
+    size_t n = 0;
+    for (; v >= 0x80; v >>= 7) p[n++] = (unsigned char)v | 0x80;
+    p[n++] = (unsigned char)v;
+    return n;
+}
+
+uint64_t get_varint(const unsigned char **p) {
+    uint64_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        unsigned char b = *(*p)++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+}
+
+// Dimensione della tabella con un contatore per ogni trigramma possibile
+#define TRI_TABLE_BYTES ((size_t)sizeof(uint32_t) << 24)
+
+/**
+ * Funzione per raggruppare per trigramma con un counting sort su una tabella di tutti i 2^24
+ * trigrammi possibili: costa TRI_TABLE_BYTES, ma solo 4 byte per coppia (trigramma, record)
+ * @return: Numero di TriEntry; *postings contiene total indici in kept, crescenti per trigramma
+ */
+uint64_t group_by_table(const Line *lines, const uint32_t *kept, uint32_t count, uint32_t *seen, uint64_t total,
+                        TriEntry **entries, uint32_t **postings) {
+    uint32_t *slot = calloc(1 << 24, sizeof(uint32_t));  // Per ogni trigramma: occorrenze, poi indice+1 in entries
+    if (slot == NULL) die("calloc");
+    for (uint32_t k = 0; k < count; k++) {
+        int nseen = line_trigrams(&lines[kept[k]], seen);
+        for (int s = 0; s < nseen; s++) slot[seen[s]]++;
+    }
+
+    // Una TriEntry per ogni trigramma presente, in ordine; first per ora è il cursore in postings
+    uint64_t nentries = 0, first = 0;
+    for (uint32_t t = 0; t < 1 << 24; t++) nentries += slot[t] != 0;
+    *entries = xmalloc(nentries * sizeof(TriEntry));
+    nentries = 0;
+    for (uint32_t t = 0; t < 1 << 24; t++) {
+        if (slot[t] == 0) continue;
+        (*entries)[nentries] = (TriEntry){ .trigram = t, .first = first, .count = slot[t] };
+        first += slot[t];
+        slot[t] = ++nentries;
+    }
+    *postings = xmalloc(total * sizeof(uint32_t));
+    for (uint32_t k = 0; k < count; k++) {
+        int nseen = line_trigrams(&lines[kept[k]], seen);
+        for (int s = 0; s < nseen; s++) (*postings)[(*entries)[slot[seen[s]] - 1].first++] = k;
+    }
+    free(slot);
+    return nentries;
+}
+
+/**
+ * Funzione per raggruppare per trigramma ordinando le coppie (trigramma, record) con un radix
+ * sort stabile sui tre byte del trigramma: 16 byte per coppia, nessuna tabella fissa. Le coppie
+ * nascono in ordine di record, e la stabilità mantiene quell'ordine dentro ogni trigramma
+ */
+uint64_t group_by_sort(const Line *lines, const uint32_t *kept, uint32_t count, uint32_t *seen, uint64_t total,
+                       TriEntry **entries, uint32_t **postings) {
+    uint64_t *pairs = xmalloc(total * sizeof(uint64_t)), *tmp = xmalloc(total * sizeof(uint64_t));
+    uint64_t n = 0;
+    for (uint32_t k = 0; k < count; k++) {
+        int nseen = line_trigrams(&lines[kept[k]], seen);
+        for (int s = 0; s < nseen; s++) pairs[n++] = (uint64_t)seen[s] << 32 | k;
+    }
+    for (int shift = 32; shift < 56; shift += 8) {
+        size_t counts[257] = {0};
+        for (uint64_t i = 0; i < n; i++) counts[((pairs[i] >> shift) & 0xff) + 1]++;
+        for (int b = 0; b < 256; b++) counts[b + 1] += counts[b];
+        for (uint64_t i = 0; i < n; i++) tmp[counts[(pairs[i] >> shift) & 0xff]++] = pairs[i];
+        uint64_t *swap = pairs;
+        pairs = tmp;
+        tmp = swap;
+    }
+    free(tmp);
+
+    uint64_t nentries = 0;
+    for (uint64_t i = 0; i < n; i++) nentries += i == 0 || pairs[i] >> 32 != pairs[i - 1] >> 32;
+    *entries = xmalloc(nentries * sizeof(TriEntry));
+    *postings = xmalloc(total * sizeof(uint32_t));
+    nentries = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t t = pairs[i] >> 32;
+        if (i == 0 || t != (*entries)[nentries - 1].trigram)
+            (*entries)[nentries++] = (TriEntry){ .trigram = t, .first = i, .count = 0 };
+        (*entries)[nentries - 1].count++;
+        (*postings)[i] = (uint32_t)pairs[i];
+    }
+    free(pairs);
+    return nentries;
+}
+
+/**
+ * Funzione per scrivere .tri: per ogni trigramma l'elenco crescente delle posizioni dei record
+ * che lo contengono, codificate come differenze in varint. Con poche coppie (una compattazione
+ * dopo qualche inserimento) le ordino; con molte (un import) uso la tabella di tutti i
+ * trigrammi, che occupa meno delle coppie da ordinare
+ * @param kept: Indici delle righe tenute, nell'ordine di .dat
+ * @param line_off: Posizione in .dat di ogni riga tenuta
+ */
+void build_trigrams(int gen, const Line *lines, const uint32_t *kept, uint32_t count, const uint64_t *line_off) {
+    uint32_t max_len = 0;
+    for (uint32_t k = 0; k < count; k++) max_len = lines[kept[k]].len > max_len ? lines[kept[k]].len : max_len;
+    uint32_t *seen = xmalloc(max_len * sizeof(uint32_t));
+    uint64_t total = 0;
+    for (uint32_t k = 0; k < count; k++) total += line_trigrams(&lines[kept[k]], seen);
+
+    TriEntry *entries;
+    uint32_t *postings;  // Indici in kept, raggruppati per trigramma e crescenti in ogni gruppo
+    uint64_t nentries = total * 16 < TRI_TABLE_BYTES
+                            ? group_by_sort(lines, kept, count, seen, total, &entries, &postings)
+                            : group_by_table(lines, kept, count, seen, total, &entries, &postings);
+    free(seen);
+
+    // Codifico le posizioni: first diventa la posizione in byte dell'elenco di ogni trigramma
+    unsigned char *data = xmalloc(total * 10);
+    size_t size = 0;
+    for (uint64_t e = 0, p = 0; e < nentries; e++) {
+        uint64_t prev = 0;
+        entries[e].first = size;
+        for (uint64_t i = 0; i < entries[e].count; i++, p++) {
+            uint64_t off = line_off[kept[postings[p]]];
+            size += put_varint(data + size, off - prev);
+            prev = off;
+        }
+    }
+    free(postings);
+
+    TriHeader th = { .count = nentries };
+    memcpy(th.magic, "ABTRI01", 8);
+    char path[512];
+    gen_path(path, sizeof(path), gen, "tri");
+    write_file(path, (const void *[]){ &th, entries, data },
+               (size_t[]){ sizeof(th), nentries * sizeof(TriEntry), size }, 3);
+    free(entries);
+    free(data);
+}
+
+/**
+ * Funzione per creare la generazione gen con le righe date: le righe con una mail già vista
+ * vengono scartate. Scrive .dat, .idx, .ord e .tri, poi rende corrente la generazione
+ * @param lines: Righe .csv, senza '\n'
+ * @param n: Numero di righe
+ * @param header: Intestazione del .csv
+ */
+void build_generation(int gen, const Line *lines, uint32_t n, const char *header) {
+    char path[512];
+
+    // Tabella hash sulla mail: prima con l'indice della riga, poi con la posizione nel .dat
+    uint64_t cap = idx_capacity(n);
+    Slot *slots = calloc(cap, sizeof(Slot));
+    uint32_t *kept = xmalloc(n * sizeof(uint32_t));
+    uint64_t *offs = xmalloc(n * sizeof(uint64_t));
+    if (slots == NULL) die("calloc");
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        size_t mail_len;
+        const char *mail = csv_field(lines[i].data, lines[i].len, 3, &mail_len);
+        uint64_t h = hash_mail(mail, mail_len), j = h & (cap - 1);
+        int dup = 0;
+        for (; slots[j].off != 0; j = (j + 1) & (cap - 1)) {
+            const Line *other = &lines[slots[j].off - 1];
+            size_t other_len;
+            const char *other_mail = csv_field(other->data, other->len, 3, &other_len);
+            if (slots[j].hash == h && other_len == mail_len && memcmp(other_mail, mail, mail_len) == 0) {
+                dup = 1;
+                break;
+            }
+        }
+        if (dup) {
+            fprintf(stderr, "Duplicate mail %.*s, skipped\n", (int)mail_len, mail);
+            continue;
+        }
+        slots[j] = (Slot){ .hash = h, .off = i + 1 };
+        kept[count++] = i;
+    }
+
+    // .dat: i record nell'ordine originale
+    gen_path(path, sizeof(path), gen, "dat");
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *dat = fopen(tmp, "w");
+    if (dat == NULL) die(tmp);
+    setvbuf(dat, NULL, _IOFBF, 1 << 20);
+    uint64_t off = 0;
+    uint64_t *line_off = xmalloc(n * sizeof(uint64_t));  // Posizione nel .dat di ogni riga tenuta
+    for (uint32_t k = 0; k < count; k++) {
+        const Line *l = &lines[kept[k]];
+        RecHeader rec = { .len = l->len, .flags = 0 };
+        fwrite(&rec, sizeof(rec), 1, dat);
+        fwrite(l->data, 1, l->len, dat);
+        line_off[kept[k]] = off;
+        off += sizeof(rec) + l->len;
+    }
+    if (fflush(dat) != 0 || fsync(fileno(dat)) == -1 || fclose(dat) != 0 || rename(tmp, path) == -1) die(path);
+
+    // .idx
+    for (uint64_t j = 0; j < cap; j++) {
+        if (slots[j].off != 0) slots[j].off = line_off[slots[j].off - 1] + 1;
+    }
+    IdxHeader ih = { .cap = cap, .used = count, .live = count, .records = count, .covered = off };
+    memcpy(ih.magic, "ABIDX02", 8);
+    gen_path(path, sizeof(path), gen, "idx");
+    write_file(path, (const void *[]){ &ih, slots }, (size_t[]){ sizeof(ih), cap * sizeof(Slot) }, 2);
+    free(slots);
+
+    // .tri (prima di ordinare kept, che ora è nell'ordine di .dat)
+    build_trigrams(gen, lines, kept, count, line_off);
+
+    // .ord: righe tenute ordinate per mail
+    sort_lines = lines;
+    qsort(kept, count, sizeof(uint32_t), compare_line_index);
+    for (uint32_t k = 0; k < count; k++) offs[k] = line_off[kept[k]];
+    OrdHeader oh = { .count = count, .covered = off };
+    memcpy(oh.magic, "ABORD01", 8);
+    gen_path(path, sizeof(path), gen, "ord");
+    write_file(path, (const void *[]){ &oh, offs }, (size_t[]){ sizeof(oh), count * sizeof(uint64_t) }, 2);
+    free(kept);
+    free(offs);
+    free(line_off);
+
+    // Intestazione e infine CURRENT: da questo momento la nuova generazione è quella corrente
+    write_file(DB_DIR "/header", (const void *[]){ header }, (size_t[]){ strlen(header) }, 1);
+    char current[32];
+    int len = snprintf(current, sizeof(current), "%d\n", gen);
+    write_file(DB_DIR "/CURRENT", (const void *[]){ current }, (size_t[]){ (size_t)len }, 1);
+    int dir_fd = open(DB_DIR, O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    // I file della generazione precedente non servono più
+    const char *exts[] = {"dat", "idx", "ord", "tri"};
+    for (int i = 0; i < 4; i++) {
+        gen_path(path, sizeof(path), gen - 1, exts[i]);
+        unlink(path);
+    }
+}
+
+/*
+ * Apertura
+ */
+
+int current_gen() {
+    FILE *f = fopen(DB_DIR "/CURRENT", "r");
+    int gen = -1;
+    if (f != NULL) {
+        if (fscanf(f, "%d", &gen) != 1) gen = -1;
+        fclose(f);
+    }
+    return gen;
+}
+
+// Funzione per mappare .dat fino alla lunghezza attuale, dopo un inserimento
+void map_dat(Db *db) {
+    struct stat st;
+    if (fstat(db->dat_fd, &st) == -1) die("fstat");
+    if (db->dat != NULL) munmap(db->dat, db->dat_size);
+    db->dat_size = st.st_size;
+    db->dat = NULL;
+    if (st.st_size > 0) {
+        db->dat = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, db->dat_fd, 0);
+        if (db->dat == MAP_FAILED) die("mmap");
+    }
+}
+
+void map_idx(Db *db) {
+    struct stat st;
+    if (fstat(db->idx_fd, &st) == -1) die("fstat");
+    db->idx = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, db->idx_fd, 0);
+    if (db->idx == MAP_FAILED) die("mmap");
+    db->slots = (Slot *)(db->idx + 1);
+}
+
+void recover_idx(Db *db);
+
+// Funzione per aprire la generazione corrente; writable apre .dat e .idx anche in scrittura e
+// reinserisce in .idx i record rimasti senza cella
+void db_open(Db *db, int writable) {
+    char path[512];
+    memset(db, 0, sizeof(*db));
+    db->gen = current_gen();
+    if (db->gen < 0) {
+        fprintf(stderr, "Invalid database in %s\n", DB_DIR);
+        exit(EXIT_FAILURE);
+    }
+    gen_path(path, sizeof(path), db->gen, "dat");
+    db->dat_fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (db->dat_fd == -1) die(path);
+    map_dat(db);
+    gen_path(path, sizeof(path), db->gen, "idx");
+    db->idx_fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (db->idx_fd == -1) die(path);
+    if (writable) {
+        map_idx(db);
+        recover_idx(db);
+    } else {
+        size_t size;
+        db->idx = map_file(path, &size);
+        db->slots = (Slot *)(db->idx + 1);
+    }
+    gen_path(path, sizeof(path), db->gen, "ord");
+    db->ord = map_file(path, &db->ord_size);
+    db->ord_offs = (uint64_t *)(db->ord + 1);
+    gen_path(path, sizeof(path), db->gen, "tri");
+    db->tri = map_file(path, &db->tri_size);
+    db->tri_entries = (TriEntry *)(db->tri + 1);
+    db->tri_postings = (const unsigned char *)(db->tri_entries + db->tri->count);
+
+    FILE *f = fopen(DB_DIR "/header", "r");
+    if (f == NULL || fgets(db->header, sizeof(db->header), f) == NULL) strcpy(db->header, DEFAULT_HEADER);
+    db->header[strcspn(db->header, "\n")] = '\0';
+    if (f != NULL) fclose(f);
+}
+
+// Funzione per cercare la cella della mail; ritorna NULL se la mail non è nella rubrica
+Slot *find_mail(Db *db, const char *mail, size_t len) {
+    uint64_t h = hash_mail(mail, len), mask = db->idx->cap - 1;
+    for (uint64_t j = h & mask; db->slots[j].off != 0; j = (j + 1) & mask) {
+        Slot *s = &db->slots[j];
+        if (s->hash != h || s->off == SLOT_DELETED) continue;
+        RecHeader *rec = record_at(db, s->off - 1);
+        if (rec->flags & REC_DELETED) continue;  // Cancellazione interrotta prima di liberare la cella
+        size_t other_len;
+        const char *other = csv_field(record_line(db, s->off - 1), rec->len, 3, &other_len);
+        if (other_len == len && memcmp(other, mail, len) == 0) return s;
+    }
+    return NULL;
+}
+
+// Funzione per leggere le righe di un file .csv; la prima riga è l'intestazione
+char *read_csv(const char *file, Line **lines, uint32_t *n, char *header, size_t header_size) {
+    size_t size;
+    char *map = map_file(file, &size);
+    if (map == NULL && access(file, R_OK) == -1) die(file);
+    char *data = xmalloc(size + 1);
+    if (size) memcpy(data, map, size);
+    if (map) munmap(map, size);
+    data[size] = '\n';
+
+    size_t cap = 1024;
+    *lines = xmalloc(cap * sizeof(Line));
+    *n = 0;
+    snprintf(header, header_size, "%s", DEFAULT_HEADER);
+    int first = 1;
+    for (char *p = data, *end = data + size; p < end;) {
+        char *nl = memchr(p, '\n', end + 1 - p);
+        size_t len = nl - p;
+        if (len > 0 && p[len - 1] == '\r') len--;
+        if (first) {
+            snprintf(header, header_size, "%.*s", (int)len, p);
+            first = 0;
+        } else if (len > 0) {
+            if (*n == cap) {
+                cap *= 2;
+                *lines = realloc(*lines, cap * sizeof(Line));
+                if (*lines == NULL) die("realloc");
+            }
+            (*lines)[(*n)++] = (Line){ .data = p, .len = len };
+        }
+        p = nl + 1;
+    }
+    return data;
+}
+
+// Funzione per sostituire la rubrica con il contenuto di un .csv (chiamata con il lock esclusivo)
+void import_csv(const char *file) {
+    Line *lines;
+    uint32_t n;
+    char header[256];
+    char *data = read_csv(file, &lines, &n, header, sizeof(header));
+    int gen = current_gen();
+    build_generation(gen < 0 ? 1 : gen + 1, lines, n, header);
+    free(lines);
+    free(data);
+}
+
+// Funzione per prendere il lock sulla rubrica, creandola dal .csv se non esiste ancora
+// (a meno che create sia 0: import la crea da sé)
+void db_lock(int mode, int create) {
+    if (mkdir(DB_DIR, 0755) == -1 && errno != EEXIST) die(DB_DIR);
+    lock_fd = open(DB_DIR "/lock", O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd == -1) die(DB_DIR "/lock");
+    flock(lock_fd, mode);
+    if (current_gen() >= 0 || !create) return;
+
+    // Rubrica vuota: la creo con il lock esclusivo (importando il .csv, se esiste)
+    flock(lock_fd, LOCK_EX);
+    if (current_gen() < 0) {
+        if (access(CSV_FILE, R_OK) == 0) import_csv(CSV_FILE);
+        else build_generation(1, NULL, 0, DEFAULT_HEADER);
+    }
+    if (mode == LOCK_SH) flock(lock_fd, LOCK_SH);
+}
+
+/*
+ * Compattazione
+ */
+
+// Funzione per riscrivere la rubrica con i soli record vivi (chiamata con il lock esclusivo)
+void compact(Db *db) {
+    uint32_t n = 0;
+    Line *lines = xmalloc((db->idx->live ? db->idx->live : 1) * sizeof(Line));
+    for (uint64_t off = 0; off < db->dat_size;) {
+        RecHeader *rec = record_at(db, off);
+        if (!(rec->flags & REC_DELETED) && n < db->idx->live)
+            lines[n++] = (Line){ .data = record_line(db, off), .len = rec->len };
+        off += sizeof(RecHeader) + rec->len;
+    }
+    build_generation(db->gen + 1, lines, n, db->header);
+    free(lines);
+}
+
+// Funzione per sapere se la coda o i tombstone sono cresciuti abbastanza da compattare
+int needs_compaction(const Db *db) {
+    uint64_t tail = db->idx->records - db->ord->count;
+    uint64_t tombstones = db->idx->records - db->idx->live;
+    return (tail >= MIN_TAIL && tail * 16 >= db->ord->count) ||
+           (tombstones >= MIN_TOMBSTONES && tombstones * 4 >= db->idx->records);
+}
+
+// Funzione per compattare in background. Il padre ha finito il suo lavoro: il figlio rilascia il
+// lock ereditato (che è lo stesso del padre), poi aspetta il lock esclusivo su un descrittore suo e
+// ricontrolla se serve ancora compattare. compact.lock evita che più figli restino in attesa insieme
+void compact_in_background() {
+    pid_t pid = fork();
+    if (pid != 0) return;
+    // Il figlio non deve tenere aperti stdout e stderr, o chi legge l'output aspetterebbe la sua fine
+    int null_fd = open("/dev/null", O_RDWR);
+    dup2(null_fd, STDIN_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    setsid();
+    flock(lock_fd, LOCK_UN);
+    int compact_fd = open(DB_DIR "/compact.lock", O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (compact_fd == -1 || flock(compact_fd, LOCK_EX | LOCK_NB) == -1) _exit(EXIT_SUCCESS);
+    lock_fd = open(DB_DIR "/lock", O_RDWR | O_CLOEXEC);
+    if (lock_fd == -1) _exit(EXIT_FAILURE);
+    flock(lock_fd, LOCK_EX);
+    Db db;
+    db_open(&db, 0);
+    if (needs_compaction(&db)) compact(&db);
+    _exit(EXIT_SUCCESS);
+}
+
+/*
+ * Comandi
+ */
+
+// Ordinamento delle posizioni della coda per view
+const Db *sort_db;
+
+int compare_offsets(const void *a, const void *b) {
+    uint64_t oa = *(const uint64_t *)a, ob = *(const uint64_t *)b;
+    size_t la, lb;
+    const char *ka = sort_key(record_line(sort_db, oa), record_at(sort_db, oa)->len, &la);
+    const char *kb = sort_key(record_line(sort_db, ob), record_at(sort_db, ob)->len, &lb);
+    return compare_keys(ka, la, kb, lb);
+}
+
+void print_record(const Db *db, uint64_t off) {
+    fwrite(record_line(db, off), 1, record_at(db, off)->len, stdout);
+    putchar('\n');
+}
+
+// view: intestazione e voci ordinate per mail. Le voci di .ord sono già ordinate; quelle della
+// coda le ordino qui e le fondo con le prime
+void view(Db *db) {
+    size_t ntail = 0, cap = 1024;
+    uint64_t *tail = xmalloc(cap * sizeof(uint64_t));
+    for (uint64_t off = db->ord->covered; off < db->dat_size;) {
+        RecHeader *rec = record_at(db, off);
+        if (!(rec->flags & REC_DELETED)) {
+            if (ntail == cap) {
+                cap *= 2;
+                tail = realloc(tail, cap * sizeof(uint64_t));
+                if (tail == NULL) die("realloc");
+            }
+            tail[ntail++] = off;
+        }
+        off += sizeof(RecHeader) + rec->len;
+    }
+    sort_db = db;
+    qsort(tail, ntail, sizeof(uint64_t), compare_offsets);
+
+    printf("%s\n", db->header);
+    size_t i = 0, j = 0;
+    while (i < db->ord->count || j < ntail) {
+        if (i < db->ord->count && record_at(db, db->ord_offs[i])->flags & REC_DELETED) {
+            i++;
+            continue;
+        }
+        if (j == ntail || (i < db->ord->count && compare_offsets(&db->ord_offs[i], &tail[j]) <= 0))
+            print_record(db, db->ord_offs[i++]);
+        else
+            print_record(db, tail[j++]);
+    }
+    free(tail);
+}
+
+// Funzione per sapere se la riga contiene needle (già in minuscolo), senza distinguere maiuscole
+int contains_nocase(const char *hay, size_t hlen, const char *needle, size_t nlen) {
+    if (nlen == 0) return 1;
+    for (size_t i = 0; i + nlen <= hlen; i++) {
+        size_t k = 0;
+        while (k < nlen && tolower((unsigned char)hay[i + k]) == needle[k]) k++;
+        if (k == nlen) return 1;
+    }
+    return 0;
+}
+
+// Stampo una voce trovata nel formato di address-book.sh
+void print_match(const Db *db, uint64_t off) {
+    const char *line = record_line(db, off);
+    size_t len = record_at(db, off)->len;
+    const char *names[] = {"Name", "Surname", "Phone", "Mail", "City", "Address"};
+    for (int f = 0; f < 6; f++) {
+        size_t flen;
+        const char *field = csv_field(line, len, f, &flen);
+        printf("%s: %.*s\n", names[f], (int)flen, field);
+    }
+    putchar('\n');
+}
+
+// Verifico e stampo una voce candidata
+int check_match(const Db *db, uint64_t off, const char *needle, size_t nlen) {
+    RecHeader *rec = record_at(db, off);
+    if (rec->flags & REC_DELETED || !contains_nocase(record_line(db, off), rec->len, needle, nlen)) return 0;
+    print_match(db, off);
+    return 1;
+}
+
+const TriEntry *find_trigram(const Db *db, uint32_t t) {
+    uint64_t lo = 0, hi = db->tri->count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (db->tri_entries[mid].trigram < t) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < db->tri->count && db->tri_entries[lo].trigram == t ? &db->tri_entries[lo] : NULL;
+}
+
+// search: con almeno tre caratteri uso il trigramma più raro della stringa per trovare i
+// candidati fra le voci indicizzate e li verifico; la coda e le stringhe più corte le scandisco
+void search(Db *db, const char *keyword) {
+    size_t nlen = strlen(keyword);
+    char *needle = xmalloc(nlen + 1);
+    for (size_t i = 0; i <= nlen; i++) needle[i] = tolower((unsigned char)keyword[i]);
+
+    int found = 0;
+    uint64_t scan_from = 0;
+    if (nlen >= 3) {
+        const TriEntry *best = NULL;
+        int missing = 0;
+        for (size_t i = 0; i + 2 < nlen && !missing; i++) {
+            const TriEntry *e = find_trigram(db, trigram_at(needle + i));
+            if (e == NULL) missing = 1;  // Nessuna voce indicizzata contiene la stringa
+            else if (best == NULL || e->count < best->count) best = e;
+        }
+        if (!missing) {
+            const unsigned char *p = db->tri_postings + best->first;
+            for (uint64_t k = 0, off = 0; k < best->count; k++) {
+                off += get_varint(&p);
+                found += check_match(db, off, needle, nlen);
+            }
+        }
+        scan_from = db->ord->covered;
+    }
+    for (uint64_t off = scan_from; off < db->dat_size;) {
+        found += check_match(db, off, needle, nlen);
+        off += sizeof(RecHeader) + record_at(db, off)->len;
+    }
+    if (!found) printf("Not found\n");
+    free(needle);
+}
+
+// Funzione per raddoppiare .idx quando è pieno per metà (chiamata con il lock esclusivo)
+void grow_idx(Db *db) {
+    uint64_t cap = db->idx->cap * 2;
+    Slot *slots = calloc(cap, sizeof(Slot));
+    if (slots == NULL) die("calloc");
+    for (uint64_t j = 0; j < db->idx->cap; j++) {
+        Slot *s = &db->slots[j];
+        if (s->off == 0 || s->off == SLOT_DELETED) continue;  // Le celle cancellate spariscono
+        uint64_t k = s->hash & (cap - 1);
+        while (slots[k].off != 0) k = (k + 1) & (cap - 1);
+        slots[k] = *s;
+    }
+    IdxHeader ih = *db->idx;
+    ih.cap = cap;
+    ih.used = ih.live;
+    char path[512];
+    gen_path(path, sizeof(path), db->gen, "idx");
+    write_file(path, (const void *[]){ &ih, slots }, (size_t[]){ sizeof(ih), cap * sizeof(Slot) }, 2);
+    free(slots);
+
+    munmap(db->idx, sizeof(IdxHeader) + db->idx->cap * sizeof(Slot));
+    close(db->idx_fd);
+    db->idx_fd = open(path, O_RDWR | O_CLOEXEC);
+    if (db->idx_fd == -1) die(path);
+    map_idx(db);
+}
+
+// Funzione per leggere un campo da standard input, come read nello script: getline legge
+// sempre la riga intera, così una riga lunga non finisce nel campo successivo.
+// Ritorna la lunghezza del campo; *field va liberato con free
+size_t read_field(const char *prompt, char **field) {
+    printf("%s: \n", prompt);
+    fflush(stdout);
+    size_t cap = 0;
+    *field = NULL;
+    if (getline(field, &cap, stdin) == -1) {
+        free(*field);
+        *field = strdup("");
+        if (*field == NULL) die("strdup");
+        return 0;
+    }
+    (*field)[strcspn(*field, "\r\n")] = '\0';
+    return strlen(*field);
+}
+
+// Funzione per rendere duraturi i byte da start a start + len di .idx; msync vuole un indirizzo
+// allineato alla pagina. Ritorna 0 se è riuscito, -1 altrimenti
+int sync_idx(const void *start, size_t len) {
+    uintptr_t page = sysconf(_SC_PAGESIZE), from = (uintptr_t)start & ~(page - 1);
+    return msync((void *)from, (uintptr_t)start + len - from, MS_SYNC);
+}
+
+// Funzione per occupare una cella di .idx con la mail di hash h e il record in off
+Slot *idx_insert(Db *db, uint64_t h, uint64_t off) {
+    if ((db->idx->used + 1) * 2 > db->idx->cap) grow_idx(db);
+    uint64_t mask = db->idx->cap - 1, j = h & mask;
+    while (db->slots[j].off != 0) j = (j + 1) & mask;
+    db->slots[j] = (Slot){ .hash = h, .off = off + 1 };
+    db->idx->used++;
+    return &db->slots[j];
+}
+
+// Funzione per reinserire in .idx i record di .dat oltre idx->covered, scritti da un inserimento
+// interrotto prima che l'intestazione di .idx arrivasse su disco (chiamata con il lock esclusivo).
+// La cella può esserci già: in quel caso mancano solo i contatori. Un record scritto a metà in
+// fondo a .dat viene tolto
+void recover_idx(Db *db) {
+    if (db->idx->covered >= db->dat_size) return;
+    for (uint64_t off = db->idx->covered; off < db->dat_size;) {
+        if (db->dat_size - off < sizeof(RecHeader) ||
+            db->dat_size - off - sizeof(RecHeader) < record_at(db, off)->len) {
+            if (ftruncate(db->dat_fd, off) == -1 || fdatasync(db->dat_fd) == -1) die("ftruncate");
+            map_dat(db);
+            break;
+        }
+        RecHeader *rec = record_at(db, off);
+        db->idx->records++;
+        if (!(rec->flags & REC_DELETED)) {
+            size_t mail_len;
+            const char *mail = csv_field(record_line(db, off), rec->len, 3, &mail_len);
+            Slot *s = find_mail(db, mail, mail_len);
+            if (s == NULL) {
+                idx_insert(db, hash_mail(mail, mail_len), off);
+                db->idx->live++;
+            } else if (s->off == off + 1) {
+                db->idx->used++;
+                db->idx->live++;
+            }
+        }
+        off += sizeof(RecHeader) + rec->len;
+    }
+    db->idx->covered = db->dat_size;
+    if (sync_idx(db->idx, sizeof(IdxHeader) + db->idx->cap * sizeof(Slot)) == -1) die("msync");
+}
+
+// Funzione per aggiungere a .dat il record con i campi dati e la sua cella a .idx.
+// Ritorna 0 se il record e la cella sono duraturi, -1 se fdatasync o msync sono falliti
+int append_record(Db *db, char *fields[6], const size_t lens[6], size_t total) {
+    // Aggiungo il record a .dat con una sola write
+    size_t size = sizeof(RecHeader) + total;
+    char *buf = xmalloc(size);
+    RecHeader rec = { .len = total, .flags = 0 };
+    memcpy(buf, &rec, sizeof(rec));
+    char *p = buf + sizeof(rec);
+    for (int f = 0; f < 6; f++) {
+        if (f > 0) *p++ = ',';
+        memcpy(p, fields[f], lens[f]);
+        p += lens[f];
+    }
+    uint64_t off = db->dat_size;
+    if (pwrite(db->dat_fd, buf, size, off) != (ssize_t)size) die("pwrite");
+    free(buf);
+    if (fdatasync(db->dat_fd) == -1) {
+        // Tolgo il record, altrimenti la prossima apertura lo reinserirebbe in .idx
+        if (ftruncate(db->dat_fd, off) == -1) die("ftruncate");
+        return -1;
+    }
+
+    // Prima la cella, poi l'intestazione con covered: se questa non arriva su disco, recover_idx
+    // ritrova il record oltre covered
+    Slot *s = idx_insert(db, hash_mail(fields[3], lens[3]), off);
+    int result = sync_idx(s, sizeof(Slot));
+    db->idx->live++;
+    db->idx->records++;
+    db->idx->covered = off + size;
+    if (sync_idx(db->idx, sizeof(IdxHeader)) == -1) result = -1;
+    map_dat(db);
+    return result;
+}
+
+void insert(Db *db) {
+    char *fields[6];
+    size_t lens[6], total = 5;  // Le cinque virgole
+    const char *names[] = {"Name", "Surname", "Phone", "Mail", "City", "Address"};
+    for (int f = 0; f < 6; f++) {
+        lens[f] = read_field(names[f], &fields[f]);
+        total += lens[f];
+    }
+
+    // Leggo comunque tutti i campi prima di rifiutare la voce, così l'input resta allineato
+    if (total > MAX_RECORD) {
+        printf("Error: Record too long\n");
+    } else if (find_mail(db, fields[3], lens[3]) != NULL) {
+        printf("Error: Mail already exists\n");
+    } else if (append_record(db, fields, lens, total) == -1) {
+        printf("Error: Cannot save record\n");
+    } else {
+        printf("Added\n");
+    }
+    for (int f = 0; f < 6; f++) free(fields[f]);
+}
+
+void delete(Db *db, const char *mail) {
+    Slot *s = find_mail(db, mail, strlen(mail));
+    if (s == NULL) {
+        printf("Cannot find any record\n");
+        return;
+    }
+    // Segno il record come cancellato in .dat, poi libero la cella in .idx: find_mail salta
+    // comunque i record cancellati, quindi una cella rimasta da un crash non lo fa ritrovare
+    uint64_t flags_off = s->off - 1 + offsetof(RecHeader, flags);
+    uint32_t old = record_at(db, s->off - 1)->flags, flags = old | REC_DELETED;
+    if (pwrite(db->dat_fd, &flags, sizeof(flags), flags_off) != sizeof(flags)) die("pwrite");
+    if (fdatasync(db->dat_fd) == -1) {
+        if (pwrite(db->dat_fd, &old, sizeof(old), flags_off) != sizeof(old)) die("pwrite");
+        printf("Error: Cannot save record\n");
+        return;
+    }
+    s->off = SLOT_DELETED;
+    int result = sync_idx(s, sizeof(Slot));
+    db->idx->live--;
+    if (sync_idx(db->idx, sizeof(IdxHeader)) == -1 || result == -1) {
+        printf("Error: Cannot save record\n");
+        return;
+    }
+    printf("Deleted\n");
+}
+
+void export_csv(Db *db, const char *file) {
+    FILE *out = fopen(file, "w");
+    if (out == NULL) die(file);
+    fprintf(out, "%s\n", db->header);
+    for (uint64_t off = 0; off < db->dat_size;) {
+        RecHeader *rec = record_at(db, off);
+        if (!(rec->flags & REC_DELETED)) {
+            fwrite(record_line(db, off), 1, rec->len, out);
+            fputc('\n', out);
+        }
+        off += sizeof(RecHeader) + rec->len;
+    }
+    if (fclose(out) != 0) die(file);
+}
+
+int main(int argc, char *argv[]) {
+    const char *usage = "Usage: %s {view|search <string>|insert|delete <mail>|import <csv>|export <csv>|compact}\n";
+    if (argc < 2) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+    const char *cmd = argv[1];
+    int needs_arg = strcmp(cmd, "search") == 0 || strcmp(cmd, "delete") == 0 ||
+                    strcmp(cmd, "import") == 0 || strcmp(cmd, "export") == 0;
+    if (needs_arg && argc < 3) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+    int writer = strcmp(cmd, "insert") == 0 || strcmp(cmd, "delete") == 0 ||
+                 strcmp(cmd, "import") == 0 || strcmp(cmd, "compact") == 0;
+    db_lock(writer ? LOCK_EX : LOCK_SH, strcmp(cmd, "import") != 0);
+
+    if (strcmp(cmd, "import") == 0) {
+        import_csv(argv[2]);
+        return 0;
+    }
+
+    Db db;
+    db_open(&db, writer);
+    if (strcmp(cmd, "view") == 0) {
+        view(&db);
+    } else if (strcmp(cmd, "search") == 0) {
+        search(&db, argv[2]);
+    } else if (strcmp(cmd, "insert") == 0) {
+        insert(&db);
+    } else if (strcmp(cmd, "delete") == 0) {
+        delete(&db, argv[2]);
+    } else if (strcmp(cmd, "export") == 0) {
+        export_csv(&db, argv[2]);
+    } else if (strcmp(cmd, "compact") == 0) {
+        compact(&db);
+        return 0;
+    } else {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+    fflush(stdout);
+    if (writer && needs_compaction(&db)) compact_in_background();
+    return 0;
+}
@@ -26,11 +26,27 @@
 #      Added
 #
 # Cancellazione: address-book.sh delete <mail> -> cancella un elemento usando come parametro la mail. Otput in caso di sucesso Delated in caso di fallimento: Not found
+#
+# Se è stato compilato address-book.c (gcc -O2 address-book.c -o address-book), i comandi vengono
+# eseguiti dal motore nativo, che tiene la rubrica indicizzata in address-book.db e la crea al
+# primo utilizzo importando address-book-database.csv. Con il motore sono disponibili anche
+# import <file.csv> ed export <file.csv>; senza, le funzioni qui sotto lavorano direttamente sul .csv.
 
 
 #!/bin/bash
 
 DATABASE="address-book-database.csv"
+ENGINE=${ENGINE:-./address-book}
+
+# Motore nativo: view stampa in .csv, l'allineamento in colonne resta a column
+if [ -x "$ENGINE" ]; then
+    case "$1" in
+        view) "$ENGINE" view | column -s, -t ;;
+        search | insert | delete | import | export) "$ENGINE" "$@" ;;
+        *) echo "Usage: $0 {view|search <string>|insert|delete <mail>|import <csv>|export <csv>}" ;;
+    esac
+    exit
+fi
 
 # Funzione per visualizzare tutte le voci nella rubrica
 view() {
@@ -23,184 +23,1570 @@ Lo stato del programma deve persistere tra i riavvii.
 
 
 */
-    
+
+/*
+Estensioni rispetto al testo dell'esercizio:
+
+Lo stato delle vetture è in un unico segmento di memoria condivisa POSIX (shm_open + mmap) che
+tutti gli operatori mappano: il primo operatore lo crea e lo riempie da catalog.txt e da
+car_state.txt, gli altri lo trovano già pronto. Lo stato di ogni vettura è un intero atomico
+cambiato con compare-and-swap, quindi lock e release non fanno system call e due operatori non
+possono noleggiare la stessa vettura. L'ultimo operatore che esce salva lo stato e rimuove il
+segmento; l'ingresso e l'uscita degli operatori sono serializzati con flock su catalog.txt.
+Ogni operatore collegato tiene un flock condiviso su car_operators.lock, che il kernel rilascia
+anche se il processo viene ucciso: chi esce è l'ultimo se ottiene il lock esclusivo, e chi entra
+e lo ottiene sa che il segmento rimasto è di operatori terminati senza quit e lo ricostruisce.
+
+Il segmento è dimensionato sul catalogo, senza un limite al numero di vetture. Contiene le
+vetture, gli identificativi (ognuno memorizzato una sola volta, le vetture ne tengono la
+posizione) e una tabella hash ad indirizzamento aperto che porta dall'identificativo alla vettura.
+
+Ogni lock e release riuscito viene aggiunto come record al write-ahead log car_wal.log prima di
+rispondere all'operatore. Le scritture di operatori concorrenti sono rese durature insieme: chi
+ottiene il mutex condiviso esegue un solo fdatasync per tutti i record scritti fino a quel momento
+e gli altri, se il loro record è già incluso, non ne eseguono un altro. Ogni vettura ha un numero
+di versione incrementato ad ogni cambio di stato, così l'ordine dei record nel log non conta.
+Ogni SNAPSHOT_RECORDS record lo stato completo viene scritto in car_state.txt (file temporaneo,
+fsync e rename) e il log viene svuotato; all'avvio lo stato è car_state.txt più i record del log.
+
+./car stress [operatori] [operazioni]: esegue lock e release casuali da più processi su una
+flotta condivisa di prova e verifica che nessuna vettura sia mai noleggiata due volte.
+./car bench: misura caricamento, ricerca (hash e, per confronto, scansione lineare) e
+lock/release su flotte di 100, 10000 e 100000 vetture.
+./car walbench [operatori] [operazioni]: lock e release concorrenti con il write-ahead log,
+riporta fsync al secondo, record per fsync e latenza di commit.
+./car serve: server per molti client su un socket UNIX (protocollo descritto prima di serve()).
+./car loadgen [connessioni] [secondi] [profondità] [vetture per richiesta]: client di carico per
+il server, riporta richieste al secondo e latenze (p50, p99, p99.9, massimo).
+./car contention [operatori] [vetture] [secondi] [esponente zipf]: operatori concorrenti su una
+flotta di prova, con scelta delle vetture uniforme o Zipf, per ogni meccanismo di
+sincronizzazione (semafori nominati per vettura, lock globale, futex per vettura, CAS); riporta
+operazioni al secondo e istogrammi di latenza di lock e release.
+
+Compilazione: gcc -O2 car.c -o car -lm
+*/
+
+#define _GNU_SOURCE  // Per accept4
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <semaphore.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <semaphore.h>
+#include <math.h>
 
-#define MAX_CARS 100
-#define SEM_PREFIX "/car_semaphore_"
-#define STATE_FILE "car_state.txt" //nome file per salvataggio stato dopo quit
+#define MAX_ID_LEN 63             // Lunghezza massima di un identificativo
+#define SHM_NAME "/car_fleet"     // Nome del segmento di memoria condivisa
+#define CATALOG_FILE "catalog.txt"
+#define STATE_FILE "car_state.txt" //nome file per salvataggio stato (snapshot)
+#define WAL_FILE "car_wal.log"    // Write-ahead log dei cambi di stato successivi allo snapshot
+#define OPERATORS_FILE "car_operators.lock" // Ogni operatore collegato vi tiene un flock condiviso
+#define SNAPSHOT_RECORDS 10000    // Record nel log dopo i quali si scrive un nuovo snapshot
+#define SOCKET_FILE "car.sock"    // Socket UNIX del server
+#define MAX_LINE 65536            // Lunghezza massima di una richiesta al server
+#define OUT_LIMIT (1 << 20)       // Risposte in attesa oltre le quali smetto di leggere da un client
+#define WAL_FAILED UINT64_MAX     // car_log: il record non è stato scritto e il cambio di stato è annullato
+
+// Stati di una vettura
+enum { CAR_FREE = 0, CAR_BUSY = 1 };
 
 // Definizione della struttura Car
 typedef struct {
-    char id[20];    // Identificativo della vettura
-    char status[10]; // Stato della vettura (free o busy)
+    uint32_t id_off;      // Posizione dell'identificativo (terminato da '\0') fra gli id del segmento
+    atomic_ullong state;  // Versione << 1 | stato (CAR_FREE o CAR_BUSY), cambiato solo con CAS
 } Car;
 
-// Array di vetture e contatore delle vetture
-Car cars[MAX_CARS];
-int car_count = 0;
+// Record del write-ahead log, seguito da id_len byte di identificativo
+typedef struct {
+    uint32_t check;       // FNV-1a del resto del record, per riconoscere un record scritto a metà
+    uint8_t status;       // Nuovo stato della vettura
+    uint8_t id_len;
+    uint16_t pad;
+    uint64_t version;     // Versione della vettura dopo il cambio di stato
+} WalRecord;
+
+// Cella della tabella hash: car è l'indice della vettura più uno, 0 se la cella è vuota
+typedef struct {
+    uint32_t hash;
+    uint32_t car;
+} Slot;
+
+// Intestazione del segmento condiviso, seguita da vetture, tabella hash e identificativi
+typedef struct {
+    size_t size;            // Dimensione dell'intero segmento
+    uint32_t car_count;     // Numero di vetture nel catalogo
+    uint32_t slot_mask;     // Numero di celle della tabella hash meno uno (potenza di due)
+    size_t cars_off, slots_off, ids_off;
+
+    // Group commit del write-ahead log
+    pthread_mutex_t sync_lock;    // Mutex condiviso fra processi, tenuto da chi esegue fdatasync
+    atomic_ullong wal_written;    // Record scritti nel log (con write già conclusa)
+    atomic_ullong wal_synced;     // Record resi duraturi da un fdatasync
+    atomic_ullong wal_records;    // Record nel log dall'ultimo snapshot
+    atomic_int snapshotting;      // 1 mentre un operatore scrive uno snapshot
+    atomic_ullong wal_truncations;  // Snapshot che hanno svuotato il log
+    atomic_int wal_broken;        // 1 se il log ha un record scritto a metà seguito da altri, fino al prossimo snapshot
+    atomic_ullong fsyncs;         // Statistiche: fdatasync eseguiti
+} Fleet;
+
+// Buffer di lunghezza variabile
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+// Elenco di identificativi letti dal catalogo, copiati uno dopo l'altro in data
+typedef struct {
+    char *data;
+    size_t len, cap;
+    uint32_t *offs;
+    size_t count, offs_cap;
+} IdList;
+
+Fleet *fleet;  // Segmento mappato
+Car *cars;     // Vetture del segmento
+Slot *slots;   // Tabella hash del segmento
+char *ids;     // Identificativi del segmento
+int lock_fd;   // catalog.txt, usato con flock per serializzare ingresso e uscita degli operatori
+int operators_fd;  // car_operators.lock, con flock condiviso finché l'operatore è collegato
+int wal_fd = -1;  // Write-ahead log, aperto in O_APPEND; con flock condiviso mentre si scrive un record
+off_t torn_end;     // Fine e lunghezza dell'ultimo record scritto a metà da questo processo, da togliere
+ssize_t torn_len;   // dal log con wal_repair (torn_len è 0 se non ce n'è)
+
+// Funzione per rendere correnti le vetture, la tabella e gli identificativi di un segmento
+void bind_fleet(Fleet *f) {
+    fleet = f;
+    cars = (Car *)((char *)f + f->cars_off);
+    slots = (Slot *)((char *)f + f->slots_off);
+    ids = (char *)f + f->ids_off;
+}
+
+// Identificativo della vettura di indice i
+const char *car_id(uint32_t i) {
+    return ids + cars[i].id_off;
+}
+
+// Funzione hash FNV-1a sull'identificativo
+uint32_t hash_id(const char *id) {
+    uint32_t h = 2166136261u;
+    for (; *id; id++) h = (h ^ (unsigned char)*id) * 16777619u;
+    return h;
+}
+
+// Funzione per trovare l'indice di una vettura: ritorna -1 se la vettura non è nel catalogo
+int find_car_index(const char *id) {
+    uint32_t h = hash_id(id);
+    for (uint32_t i = h & fleet->slot_mask;; i = (i + 1) & fleet->slot_mask) { // Scansione lineare delle celle
+        if (slots[i].car == 0) return -1; // Cella vuota: la vettura non c'è
+        if (slots[i].hash == h && strcmp(car_id(slots[i].car - 1), id) == 0) return slots[i].car - 1;
+    }
+}
+
+// Funzione per aggiungere un identificativo all'elenco
+void id_list_add(IdList *list, const char *id) {
+    size_t len = strlen(id) + 1;
+    if (list->len + len > list->cap) {
+        list->cap = (list->len + len) * 2;
+        list->data = realloc(list->data, list->cap);
+    }
+    if (list->count == list->offs_cap) {
+        list->offs_cap = list->offs_cap ? list->offs_cap * 2 : 256;
+        list->offs = realloc(list->offs, list->offs_cap * sizeof(uint32_t));
+    }
+    if (list->data == NULL || list->offs == NULL) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(list->data + list->len, id, len);
+    list->offs[list->count++] = list->len;
+    list->len += len;
+}
 
-// Funzione per caricare il catalogo delle vetture dal file catalog.txt
-void load_catalog() {
-    FILE *file = fopen("catalog.txt", "r"); // Apro il file catalog.txt in modalità lettura
+// Funzione per leggere gli identificativi delle vetture dal file catalog.txt
+void read_catalog(IdList *list) {
+    FILE *file = fopen(CATALOG_FILE, "r"); // Apro il file catalog.txt in modalità lettura
     if (file == NULL) {
         perror("Error opening catalog file"); // Stampo un messaggio di errore se il file non può essere aperto
         exit(EXIT_FAILURE); // Esco dal programma con codice di errore
     }
 
-    // Leggo ogni identificativo di vettura e lo memorizzo nell'array cars
-    while (fscanf(file, "%s", cars[car_count].id) != EOF) {
-        car_count++; // Incremento il contatore delle vetture
+    // Leggo al più MAX_ID_LEN + 1 caratteri, così riconosco gli identificativi troppo lunghi
+    char id[MAX_ID_LEN + 2];
+    while (fscanf(file, "%64s", id) == 1) {
+        if (strlen(id) > MAX_ID_LEN) {
+            fprintf(stderr, "Car id too long in %s: %s...\n", CATALOG_FILE, id);
+            exit(EXIT_FAILURE);
+        }
+        id_list_add(list, id);
     }
 
     fclose(file); // Chiudo il file
+}
+
+// Funzione per creare un segmento con le vetture dell'elenco, tutte libere. Con fd = -1 il
+// segmento è anonimo (condiviso solo con i figli), altrimenti è l'oggetto di memoria condivisa fd
+Fleet *build_fleet(const IdList *list, int fd) {
+    uint32_t nslots = 16;
+    while (nslots < list->count * 2) nslots *= 2; // Tabella piena al più per metà
+
+    size_t cars_off = (sizeof(Fleet) + 63) & ~(size_t)63;
+    size_t slots_off = cars_off + list->count * sizeof(Car);
+    size_t ids_off = slots_off + nslots * sizeof(Slot);
+    size_t size = ids_off + list->len;
+
+    if (fd != -1 && ftruncate(fd, size) == -1) {
+        perror("Error resizing shared memory");
+        exit(EXIT_FAILURE);
+    }
+    Fleet *f = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | (fd == -1 ? MAP_ANONYMOUS : 0), fd, 0);
+    if (f == MAP_FAILED) {
+        perror("Error mapping shared memory");
+        exit(EXIT_FAILURE);
+    }
+    // Il segmento è già azzerato: tutte le celle vuote, tutte le vetture CAR_FREE
+    f->size = size;
+    f->slot_mask = nslots - 1;
+    f->cars_off = cars_off;
+    f->slots_off = slots_off;
+    f->ids_off = ids_off;
+    // Il mutex è robusto: se chi lo tiene muore, il prossimo operatore lo ottiene comunque
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&f->sync_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    bind_fleet(f);
+    memcpy(ids, list->data, list->len);
 
-    // Provo a caricare lo stato dal file di stato
+    for (size_t k = 0; k < list->count; k++) {
+        const char *id = ids + list->offs[k];
+        if (find_car_index(id) != -1) { // Identificativo ripetuto nel catalogo: tengo il primo
+            fprintf(stderr, "Duplicate car %s in %s, ignored\n", id, CATALOG_FILE);
+            continue;
+        }
+        uint32_t h = hash_id(id), i = h & f->slot_mask;
+        while (slots[i].car != 0) i = (i + 1) & f->slot_mask;
+        cars[f->car_count].id_off = list->offs[k];
+        slots[i] = (Slot){ .hash = h, .car = ++f->car_count };
+    }
+    return f;
+}
+
+// Funzione FNV-1a su un blocco di byte, per il controllo dei record del log
+uint32_t hash_bytes(const void *data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ ((const unsigned char *)data)[i]) * 16777619u;
+    return h;
+}
+
+// Funzione per applicare uno stato salvato a una vettura, se è più recente di quello che ha
+void apply_state(const char *id, int busy, uint64_t version) {
+    int index = find_car_index(id); // Le vetture non più in catalogo vengono ignorate
+    if (index == -1) return;
+    uint64_t state = atomic_load(&cars[index].state);
+    if (version >= (state >> 1)) atomic_store(&cars[index].state, version << 1 | (busy ? CAR_BUSY : CAR_FREE));
+}
+
+// Funzione per caricare lo stato salvato: prima lo snapshot, poi i record del log successivi
+void load_state() {
     FILE *state_file = fopen(STATE_FILE, "r");
-    if (state_file != NULL) {
-        for (int i = 0; i < car_count; i++) {
-            fscanf(state_file, "%s %s", cars[i].id, cars[i].status); // Carico l'identificativo e lo stato
+    if (state_file != NULL) { // Se il file di stato non esiste, tutte le vetture sono libere
+        // Ogni riga è "id stato versione"; le righe scritte prima del log non hanno la versione
+        char line[256], id[MAX_ID_LEN + 2], status[10];
+        unsigned long long version;
+        while (fgets(line, sizeof(line), state_file) != NULL) {
+            int fields = sscanf(line, "%64s %9s %llu", id, status, &version);
+            if (fields >= 2) apply_state(id, strcmp(status, "busy") == 0, fields == 3 ? version : 0);
         }
         fclose(state_file);
-    } else {
-        // Se il file di stato non esiste, imposto tutte le vetture a "free"
-        for (int i = 0; i < car_count; i++) {
-            strcpy(cars[i].status, "free");
-        }
     }
+
+    // Rileggo il log dall'ultimo snapshot; mi fermo al primo record incompleto o corrotto
+    int fd = open(WAL_FILE, O_RDWR);
+    if (fd == -1) return;
+    struct stat st;
+    char *log = NULL;
+    if (fstat(fd, &st) == -1 || (log = malloc(st.st_size + 1)) == NULL) {
+        perror("Error reading log");
+        exit(EXIT_FAILURE);
+    }
+    ssize_t len = read(fd, log, st.st_size);
+    size_t off = 0, records = 0;
+    while (len > 0 && off + sizeof(WalRecord) <= (size_t)len) {
+        WalRecord rec;
+        memcpy(&rec, log + off, sizeof(rec));
+        size_t size = sizeof(rec) + rec.id_len;
+        if (off + size > (size_t)len || rec.id_len > MAX_ID_LEN ||
+            hash_bytes(log + off + sizeof(uint32_t), size - sizeof(uint32_t)) != rec.check)
+            break;
+        char id[MAX_ID_LEN + 1];
+        memcpy(id, log + off + sizeof(rec), rec.id_len);
+        id[rec.id_len] = '\0';
+        apply_state(id, rec.status == CAR_BUSY, rec.version);
+        off += size;
+        records++;
+    }
+    // Tolgo la coda scritta a metà, altrimenti i record aggiunti dopo non sarebbero rileggibili
+    if (off < (size_t)st.st_size && ftruncate(fd, off) == -1) perror("Error truncating log");
+    atomic_store(&fleet->wal_records, records);
+    free(log);
+    close(fd);
 }
 
-// Funzione per inizializzare i semafori nominati per ciascuna vettura
-void init_semaphores() {
-    for (int i = 0; i < car_count; i++) { // Ciclo attraverso tutte le vetture nel catalogo
-        char sem_name[50]; // Array per memorizzare il nome del semaforo
-        snprintf(sem_name, 50, "%s%s", SEM_PREFIX, cars[i].id); // Creo il nome del semaforo usando il prefisso e l'identificativo della vettura
-        sem_t *sem = sem_open(sem_name, O_CREAT, 0644, 1); // Creo il semaforo con valore iniziale 1
-        if (sem == SEM_FAILED) { // Controllo se la creazione del semaforo è fallita
-            perror("Error creating semaphore"); // Stampo un messaggio di errore
-            exit(EXIT_FAILURE); // Esco dal programma con codice di errore
+// Funzione per aprire il write-ahead log in aggiunta
+void open_wal() {
+    wal_fd = open(WAL_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (wal_fd == -1) {
+        perror("Error opening log");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Funzione per collegarsi al segmento condiviso, creandolo e riempiendolo se non esiste
+void attach_fleet() {
+    lock_fd = open(CATALOG_FILE, O_RDONLY);
+    if (lock_fd == -1) {
+        perror("Error opening catalog file");
+        exit(EXIT_FAILURE);
+    }
+    flock(lock_fd, LOCK_EX); // Nessun altro operatore entra o esce mentre preparo il segmento
+
+    operators_fd = open(OPERATORS_FILE, O_RDONLY | O_CREAT, 0644);
+    if (operators_fd == -1) {
+        perror("Error opening operators lock");
+        exit(EXIT_FAILURE);
+    }
+    // Se nessun operatore vivo tiene il lock condiviso, un segmento rimasto è di operatori uccisi
+    // senza quit: lo rimuovo e ricarico lo stato da snapshot e log, che contengono ogni cambio confermato
+    if (flock(operators_fd, LOCK_EX | LOCK_NB) == 0) shm_unlink(SHM_NAME);
+    flock(operators_fd, LOCK_SH); // Resto contato fra gli operatori fino all'uscita
+
+    int fd = shm_open(SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0644); // Provo a creare il segmento
+    if (fd != -1) {
+        // Sono il primo operatore: leggo il catalogo e lo stato salvato
+        IdList list = {0};
+        read_catalog(&list);
+        build_fleet(&list, fd);
+        free(list.data);
+        free(list.offs);
+        load_state();
+    } else {
+        // Il segmento esiste già: lo mappo con la dimensione scelta da chi l'ha creato
+        struct stat st;
+        fd = shm_open(SHM_NAME, O_RDWR, 0);
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            perror("Error opening shared memory");
+            exit(EXIT_FAILURE);
         }
-        sem_close(sem); // Chiudo il semaforo
+        Fleet *f = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (f == MAP_FAILED) {
+            perror("Error mapping shared memory");
+            exit(EXIT_FAILURE);
+        }
+        bind_fleet(f);
     }
+    close(fd); // La mappatura resta valida anche dopo la chiusura
+    open_wal();
+    flock(lock_fd, LOCK_UN);
 }
 
 // Funzione per visualizzare lo stato delle vetture
 void view() {
-    for (int i = 0; i < car_count; i++) { // Ciclo attraverso tutte le vetture nel catalogo
-        printf("Car: %s, status: %s\n", cars[i].id, cars[i].status); // Stampo l'identificativo e lo stato di ciascuna vettura
+    for (uint32_t i = 0; i < fleet->car_count; i++) { // Ciclo attraverso tutte le vetture nel catalogo
+        const char *status = (atomic_load(&cars[i].state) & 1) == CAR_BUSY ? "busy" : "free";
+        printf("Car: %s, status: %s\n", car_id(i), status); // Stampo l'identificativo e lo stato di ciascuna vettura
     }
 }
 
-// Funzione per trovare l'indice di una vettura nell'array cars
-int find_car_index(char *car_id) {
-    for (int i = 0; i < car_count; i++) { // Ciclo attraverso tutte le vetture nel catalogo
-        if (strcmp(cars[i].id, car_id) == 0) { // Confronto l'identificativo della vettura con l'identificativo cercato
-            return i; // Ritorno l'indice della vettura se trovata
+// Funzione per portare una vettura dallo stato from allo stato to in modo atomico.
+// Ritorna la nuova versione della vettura, 0 se la vettura non era nello stato from
+uint64_t car_transition(Car *car, unsigned from, unsigned to) {
+    uint64_t state = atomic_load(&car->state);
+    do {
+        if ((state & 1) != from) return 0;
+    } while (!atomic_compare_exchange_weak(&car->state, &state, ((state >> 1) + 1) << 1 | to));
+    return (state >> 1) + 1;
+}
+
+// Funzione per attendere che i primi ticket record del log siano duraturi. Chi ottiene il mutex
+// esegue un fdatasync che copre tutti i record scritti fino a quel momento, anche quelli degli
+// altri operatori, che nel frattempo aspettano sul mutex e poi trovano il loro record già incluso.
+// Ritorna 0 se i record sono duraturi, -1 se fdatasync è fallito: wal_synced non avanza, così
+// chi aspetta lo stesso ticket riprova invece di considerarlo duraturo
+int wal_commit(uint64_t ticket) {
+    if (atomic_load(&fleet->wal_synced) >= ticket) return 0;
+    int err = pthread_mutex_lock(&fleet->sync_lock);
+    if (err == EOWNERDEAD) pthread_mutex_consistent(&fleet->sync_lock); // Il precedente leader è morto
+    int result = 0;
+    if (atomic_load(&fleet->wal_synced) < ticket) {
+        uint64_t target = atomic_load(&fleet->wal_written); // Tutti questi record hanno già completato write
+        atomic_fetch_add(&fleet->fsyncs, 1);
+        if (fdatasync(wal_fd) == -1) {
+            perror("fdatasync");
+            result = -1;
+        } else if (atomic_load(&fleet->wal_synced) < target) {
+            atomic_store(&fleet->wal_synced, target);
         }
     }
-    return -1; // Ritorno -1 se la vettura non è trovata
+    pthread_mutex_unlock(&fleet->sync_lock);
+    return result;
+}
+
+int write_snapshot();
+void snapshot();
+
+// Funzione per riportare nello stato from una vettura che un cambio di stato from -> to ha portato
+// alla versione version. Se nel frattempo un altro operatore l'ha già cambiata (e registrata), il
+// suo record resta valido e non tocco nulla. Ritorna la nuova versione, 0 se non ho annullato nulla
+uint64_t car_undo(int index, unsigned from, unsigned to, uint64_t version) {
+    uint64_t state = version << 1 | to;
+    return atomic_compare_exchange_strong(&cars[index].state, &state, (version + 1) << 1 | from) ? version + 1 : 0;
+}
+
+// Funzione per aggiungere al log il record della vettura index nello stato status alla versione
+// version, senza attendere che sia duraturo. Va chiamata con il flock condiviso sul log.
+// Ritorna il ticket da passare a wal_commit, WAL_FAILED se il record non è stato scritto; se la
+// write è stata parziale annota il record in torn_end e torn_len
+uint64_t wal_write(int index, unsigned status, uint64_t version) {
+    if (atomic_load(&fleet->wal_broken)) return WAL_FAILED;
+
+    // Costruisco il record e lo scrivo con una sola write: con O_APPEND non si mescola agli altri
+    char buf[sizeof(WalRecord) + MAX_ID_LEN];
+    const char *id = car_id(index);
+    WalRecord rec = { .status = status, .id_len = strlen(id), .version = version };
+    memcpy(buf, &rec, sizeof(rec));
+    memcpy(buf + sizeof(rec), id, rec.id_len);
+    rec.check = hash_bytes(buf + sizeof(uint32_t), sizeof(rec) + rec.id_len - sizeof(uint32_t));
+    memcpy(buf, &rec.check, sizeof(rec.check));
+    ssize_t written = write(wal_fd, buf, sizeof(rec) + rec.id_len);
+    if (written == (ssize_t)(sizeof(rec) + rec.id_len)) return atomic_fetch_add(&fleet->wal_written, 1) + 1;
+
+    if (written == -1) {
+        perror("Error writing log");
+    } else {
+        fprintf(stderr, "Error writing log: short write\n");
+        torn_end = lseek(wal_fd, 0, SEEK_CUR); // Con O_APPEND la posizione è la fine dei byte scritti
+        torn_len = written;
+    }
+    return WAL_FAILED;
+}
+
+// Funzione per togliere dal log il record scritto a metà annotato da wal_write: load_state si ferma
+// al primo record incompleto, quindi perderebbe quelli aggiunti dopo. Va chiamata con il flock
+// condiviso, che converto in esclusivo per non avere scritture in corso. Se il record è ancora in
+// fondo al log lo tronco, altrimenti scrivo uno snapshot che contiene anche i record successivi e
+// svuota il log; se anche lo snapshot fallisce il log resta inutilizzabile fino al prossimo
+void wal_repair() {
+    if (torn_len == 0) return;
+    uint64_t truncations = atomic_load(&fleet->wal_truncations);
+    flock(wal_fd, LOCK_EX); // La conversione non è atomica: nel frattempo uno snapshot può aver svuotato il log
+    if (atomic_load(&fleet->wal_truncations) == truncations) {
+        struct stat st;
+        int at_end = torn_end != -1 && fstat(wal_fd, &st) == 0 && st.st_size == torn_end;
+        if (!(at_end && ftruncate(wal_fd, torn_end - torn_len) == 0) && write_snapshot() == -1) {
+            fprintf(stderr, "Error: log unusable until the next snapshot\n");
+            atomic_store(&fleet->wal_broken, 1);
+        }
+    }
+    flock(wal_fd, LOCK_SH);
+    torn_len = 0;
+}
+
+// Funzione per cambiare lo stato di una vettura e scrivere il record nel log, senza attendere
+// che sia duraturo. Va chiamata con il flock condiviso sul log, che impedisce a uno snapshot di
+// svuotare il log fra il cambio di stato e la scrittura del record.
+// Ritorna il ticket da passare a wal_commit (e in version la nuova versione della vettura),
+// 0 se la vettura non era nello stato from, WAL_FAILED se la write è fallita: in quel caso il
+// cambio di stato viene annullato
+uint64_t car_log(int index, unsigned from, unsigned to, uint64_t *version) {
+    *version = car_transition(&cars[index], from, to);
+    if (*version == 0) return 0;
+    uint64_t ticket = wal_write(index, to, *version);
+    if (ticket == WAL_FAILED) {
+        car_undo(index, from, to, *version);
+        wal_repair(); // Dopo l'annullamento, così un eventuale snapshot non contiene il cambio di stato
+    }
+    return ticket;
+}
+
+// Funzione per annullare un cambio di stato il cui commit è fallito: riporto la vettura in from e
+// registro l'annullamento nel log, che diventa duraturo con il prossimo commit riuscito. Fino ad
+// allora un crash può lasciare la vettura in uno qualsiasi dei due stati
+void car_revert(int index, unsigned from, unsigned to, uint64_t version) {
+    flock(wal_fd, LOCK_SH);
+    uint64_t undone = car_undo(index, from, to, version);
+    if (undone != 0 && wal_write(index, from, undone) == WAL_FAILED) wal_repair();
+    flock(wal_fd, LOCK_UN);
+}
+
+// Funzione per contare records nuovi record nel log e, se è cresciuto abbastanza, scrivere uno
+// snapshot. Un solo operatore alla volta scrive lo snapshot
+void wal_added(uint64_t records) {
+    int idle = 0;
+    if (atomic_fetch_add(&fleet->wal_records, records) + records >= SNAPSHOT_RECORDS &&
+        atomic_compare_exchange_strong(&fleet->snapshotting, &idle, 1)) {
+        snapshot();
+        atomic_store(&fleet->snapshotting, 0);
+    }
+}
+
+// Funzione per cambiare lo stato di una vettura e registrarlo nel log.
+// Ritorna 1 se il cambio di stato è riuscito ed è duraturo, 0 se la vettura non era nello stato from,
+// -1 se non è stato possibile scrivere il record o renderlo duraturo
+int car_update(int index, unsigned from, unsigned to) {
+    uint64_t version;
+    flock(wal_fd, LOCK_SH);
+    uint64_t ticket = car_log(index, from, to, &version);
+    flock(wal_fd, LOCK_UN);
+    if (ticket == 0) return 0;
+    if (ticket == WAL_FAILED) return -1;
+
+    if (wal_commit(ticket) == -1) {
+        car_revert(index, from, to, version);
+        return -1;
+    }
+    wal_added(1);
+    return 1;
 }
 
 // Funzione per noleggiare una vettura
-void lock(char *car_id) {
-    int index = find_car_index(car_id); // Trovo l'indice della vettura usando il suo identificativo
+void lock(const char *id) {
+    int index = find_car_index(id); // Trovo l'indice della vettura usando il suo identificativo
     if (index == -1) { // Controllo se la vettura non esiste nel catalogo
-        printf("Cannot find car %s\n", car_id); // Stampo un messaggio di errore
+        printf("Cannot find car %s\n", id); // Stampo un messaggio di errore
         return; // Esco dalla funzione
     }
 
-    char sem_name[50]; // Array per memorizzare il nome del semaforo
-    snprintf(sem_name, 50, "%s%s", SEM_PREFIX, car_id); // Creo il nome del semaforo usando il prefisso e l'identificativo della vettura
-    sem_t *sem = sem_open(sem_name, 0); // Apro il semaforo esistente
-    sem_wait(sem); // Attendo che il semaforo diventi disponibile
-
-    if (strcmp(cars[index].status, "free") == 0) { // Controllo se la vettura è libera
-        strcpy(cars[index].status, "busy"); // Cambio lo stato della vettura a "busy"
-        printf("Car: %s is now locked\n", car_id); // Stampo un messaggio di successo
+    int done = car_update(index, CAR_FREE, CAR_BUSY);
+    if (done == 1) { // Se la vettura è libera la segno noleggiata
+        printf("Car: %s is now locked\n", id); // Stampo un messaggio di successo
+    } else if (done == -1) {
+        printf("Error. Cannot record lock of car %s\n", id);
     } else {
-        printf("Error. Car %s already locked\n", car_id); // Stampo un messaggio di errore se la vettura è già noleggiata
+        printf("Error. Car %s already locked\n", id); // Stampo un messaggio di errore se la vettura è già noleggiata
     }
-
-    sem_post(sem); // Rilascio il semaforo
-    sem_close(sem); // Chiudo il semaforo
 }
 
 // Funzione per rilasciare una vettura
-void release(char *car_id) {
-    int index = find_car_index(car_id); // Trovo l'indice della vettura usando il suo identificativo
+void release(const char *id) {
+    int index = find_car_index(id); // Trovo l'indice della vettura usando il suo identificativo
     if (index == -1) { // Controllo se la vettura non esiste nel catalogo
-        printf("Cannot find car %s\n", car_id); // Stampo un messaggio di errore
+        printf("Cannot find car %s\n", id); // Stampo un messaggio di errore
         return; // Esco dalla funzione
     }
 
-    char sem_name[50]; // Array per memorizzare il nome del semaforo
-    snprintf(sem_name, 50, "%s%s", SEM_PREFIX, car_id); // Creo il nome del semaforo usando il prefisso e l'identificativo della vettura
-    sem_t *sem = sem_open(sem_name, 0); // Apro il semaforo esistente
-    sem_wait(sem); // Attendo che il semaforo diventi disponibile
-
-    if (strcmp(cars[index].status, "busy") == 0) { // Controllo se la vettura è noleggiata
-        strcpy(cars[index].status, "free"); // Cambio lo stato della vettura a "free"
-        printf("Car: %s is now free\n", car_id); // Stampo un messaggio di successo
+    int done = car_update(index, CAR_BUSY, CAR_FREE);
+    if (done == 1) { // Se la vettura è noleggiata la segno libera
+        printf("Car: %s is now free\n", id); // Stampo un messaggio di successo
+    } else if (done == -1) {
+        printf("Error. Cannot record release of car %s\n", id);
     } else {
-        printf("Error. Car %s already free\n", car_id); // Stampo un messaggio di errore se la vettura è già libera
+        printf("Error. Car %s already free\n", id); // Stampo un messaggio di errore se la vettura è già libera
     }
-
-    sem_post(sem); // Rilascio il semaforo
-    sem_close(sem); // Chiudo il semaforo
 }
 
-// Funzione per salvare lo stato delle vetture su un file
-void save_state() {
-    FILE *state_file = fopen(STATE_FILE, "w"); // Apro il file di stato in modalità scrittura
+// Funzione per salvare lo stato delle vetture su un file (snapshot) e svuotare il log; va chiamata
+// con il flock esclusivo sul log. Lo snapshot viene scritto in un file temporaneo e rinominato, così
+// car_state.txt è sempre completo. Ritorna 0 se lo snapshot è duraturo, -1 se non è stato possibile
+// scriverlo o svuotare il log: in quel caso il log resta com'era
+int write_snapshot() {
+    FILE *state_file = fopen(STATE_FILE ".tmp", "w"); // Apro il file temporaneo in modalità scrittura
     if (state_file == NULL) {
         perror("Error opening state file"); // Stampo un messaggio di errore se il file non può essere aperto
-        exit(EXIT_FAILURE); // Esco dal programma con codice di errore
+        return -1;
     }
 
-    // Scrivo l'identificativo e lo stato di ciascuna vettura nel file
-    for (int i = 0; i < car_count; i++) {
-        fprintf(state_file, "%s %s\n", cars[i].id, cars[i].status);
+    // Scrivo l'identificativo, lo stato e la versione di ciascuna vettura nel file
+    for (uint32_t i = 0; i < fleet->car_count; i++) {
+        uint64_t state = atomic_load(&cars[i].state);
+        fprintf(state_file, "%s %s %llu\n", car_id(i), (state & 1) == CAR_BUSY ? "busy" : "free",
+                (unsigned long long)(state >> 1));
     }
 
-    fclose(state_file); // Chiudo il file
+    // Rendo duraturo il file prima di rinominarlo, poi la directory che contiene il nuovo nome
+    int failed = fflush(state_file) != 0 || fsync(fileno(state_file)) == -1;
+    if (fclose(state_file) != 0 || failed || rename(STATE_FILE ".tmp", STATE_FILE) == -1) {
+        perror("Error writing state file");
+        unlink(STATE_FILE ".tmp");
+        return -1;
+    }
+    int dir_fd = open(".", O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    // Lo snapshot contiene tutti i record del log: posso svuotarlo
+    if (ftruncate(wal_fd, 0) == -1) {
+        perror("Error truncating log");
+        return -1;
+    }
+    atomic_store(&fleet->wal_records, 0);
+    atomic_fetch_add(&fleet->wal_truncations, 1);
+    atomic_store(&fleet->wal_broken, 0);
+    return 0;
 }
 
-// Funzione per terminare il programma e rimuovere i semafori
+// Funzione per scrivere uno snapshot aspettando i record in scrittura; esco se non riesco
+void snapshot() {
+    flock(wal_fd, LOCK_EX); // Aspetto i record in scrittura e blocco i nuovi
+    int result = write_snapshot();
+    flock(wal_fd, LOCK_UN);
+    if (result == -1) exit(EXIT_FAILURE); // Esco dal programma con codice di errore
+}
+
+// Funzione per terminare il programma: se sono l'ultimo operatore salvo uno snapshot e rimuovo il segmento.
+// Gli altri non devono salvare nulla: i loro cambi di stato sono già nel log
 void quit() {
-    save_state(); // Salvo lo stato delle vetture
-    for (int i = 0; i < car_count; i++) { // Ciclo attraverso tutte le vetture nel catalogo
-        char sem_name[50]; // Array per memorizzare il nome del semaforo
-        snprintf(sem_name, 50, "%s%s", SEM_PREFIX, cars[i].id); // Creo il nome del semaforo usando il prefisso e l'identificativo della vettura
-        sem_unlink(sem_name); // Rimuovo il semaforo
+    flock(lock_fd, LOCK_EX);
+    // Sono l'ultimo se nessun altro operatore vivo tiene il lock condiviso
+    if (flock(operators_fd, LOCK_EX | LOCK_NB) == 0) {
+        snapshot(); // Salvo lo stato delle vetture
+        shm_unlink(SHM_NAME); // Il prossimo operatore ricaricherà lo stato da car_state.txt
     }
+    flock(lock_fd, LOCK_UN);
     exit(EXIT_SUCCESS); // Esco dal programma con codice di successo
 }
 
-int main() {
-    load_catalog();  // Carico il catalogo delle vetture
-    init_semaphores();  // Inizializzo i semafori per le vetture
+// Tempo corrente in nanosecondi
+long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Funzione per creare una flotta anonima di n vetture con identificativi sintetici CAR000000, ...
+Fleet *test_fleet(int n) {
+    IdList list = {0};
+    char id[MAX_ID_LEN + 1];
+    for (int i = 0; i < n; i++) {
+        snprintf(id, sizeof(id), "CAR%06d", i);
+        id_list_add(&list, id);
+    }
+    Fleet *f = build_fleet(&list, -1);
+    free(list.data);
+    free(list.offs);
+    return f;
+}
+
+// Test di stress: procs processi eseguono ops tentativi di lock/release su vetture casuali di una
+// flotta condivisa di prova. Per ogni vettura holders conta i processi che credono di averla
+// noleggiata: se dopo un lock riuscito vale più di 1, la stessa vettura è stata noleggiata due volte
+int stress(int procs, long ops) {
+    int n = 8; // Poche vetture, così i processi si contendono spesso la stessa
+    Fleet *test = test_fleet(n);
+    atomic_long *holders = mmap(NULL, n * sizeof(atomic_long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    atomic_long *counters = mmap(NULL, 3 * sizeof(atomic_long), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (holders == MAP_FAILED || counters == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    // counters[0]: lock riusciti, counters[1]: noleggi doppi, counters[2]: nanosecondi spesi in lock/release
+
+    for (int p = 0; p < procs; p++) {
+        if (fork() == 0) {
+            unsigned seed = getpid();
+            long long spent = 0;
+            for (long i = 0; i < ops; i++) {
+                int index = rand_r(&seed) % n;
+                long long start = now_ns();
+                int got = car_transition(&cars[index], CAR_FREE, CAR_BUSY) != 0;
+                spent += now_ns() - start;
+                if (!got) continue;
+                atomic_fetch_add(&counters[0], 1);
+                if (atomic_fetch_add(&holders[index], 1) != 0) atomic_fetch_add(&counters[1], 1);
+                atomic_fetch_sub(&holders[index], 1);
+                start = now_ns();
+                if (!car_transition(&cars[index], CAR_BUSY, CAR_FREE)) atomic_fetch_add(&counters[1], 1);
+                spent += now_ns() - start;
+            }
+            atomic_fetch_add(&counters[2], spent);
+            exit(EXIT_SUCCESS);
+        }
+    }
+    while (wait(NULL) > 0);
+
+    long locks = atomic_load(&counters[0]), doubles = atomic_load(&counters[1]);
+    for (int i = 0; i < n; i++) {
+        if ((atomic_load(&cars[i].state) & 1) != CAR_FREE) doubles++; // Alla fine sono tutte libere
+    }
+    long calls = procs * ops + locks; // Ogni tentativo è un CAS, ogni lock riuscito è seguito da un release
+    printf("Operators: %d, attempts: %ld, locks: %ld, double rentals: %ld, %.0f ns per operation\n",
+           procs, procs * ops, locks, doubles, (double)atomic_load(&counters[2]) / calls);
+    munmap(test, test->size);
+    return doubles == 0 ? 0 : 1;
+}
+
+// Ricerca lineare con strcmp, come faceva find_car_index prima della tabella hash: solo per confronto
+int find_car_linear(const char *id) {
+    for (uint32_t i = 0; i < fleet->car_count; i++) {
+        if (strcmp(car_id(i), id) == 0) return i;
+    }
+    return -1;
+}
+
+// Benchmark: per flotte di 100, 10000 e 100000 vetture misuro il tempo di caricamento e il
+// costo medio di una ricerca con la tabella hash, di una ricerca lineare e di lock + release
+int bench() {
+    int sizes[] = {100, 10000, 100000};
+    printf("%8s %10s %12s %12s %14s\n", "cars", "load_ms", "lookup_ns", "linear_ns", "lock_rel_ns");
+    for (int s = 0; s < 3; s++) {
+        int n = sizes[s];
+        long long start = now_ns();
+        Fleet *test = test_fleet(n);
+        double load_ms = (now_ns() - start) / 1e6;
+
+        // Preparo in anticipo gli identificativi da cercare, scelti a caso
+        int queries = 1000000;
+        char (*keys)[MAX_ID_LEN + 1] = malloc(1024 * sizeof(*keys));
+        unsigned seed = 1;
+        for (int i = 0; i < 1024; i++) snprintf(keys[i], MAX_ID_LEN + 1, "CAR%06d", rand_r(&seed) % n);
+
+        long found = 0;
+        start = now_ns();
+        for (int i = 0; i < queries; i++) found += find_car_index(keys[i & 1023]) >= 0;
+        double lookup_ns = (double)(now_ns() - start) / queries;
+
+        // La ricerca lineare costa O(n): riduco le ripetizioni per non aspettare troppo
+        int linear_queries = n >= 10000 ? 2000 : queries;
+        start = now_ns();
+        for (int i = 0; i < linear_queries; i++) found += find_car_linear(keys[i & 1023]) >= 0;
+        double linear_ns = (double)(now_ns() - start) / linear_queries;
+
+        start = now_ns();
+        for (int i = 0; i < queries; i++) {
+            int index = find_car_index(keys[i & 1023]);
+            found += car_transition(&cars[index], CAR_FREE, CAR_BUSY) != 0;
+            found += car_transition(&cars[index], CAR_BUSY, CAR_FREE) != 0;
+        }
+        double lock_ns = (double)(now_ns() - start) / queries;
+
+        if (found != 3L * queries + linear_queries) fprintf(stderr, "Unexpected lookup failures\n");
+        printf("%8d %10.2f %12.1f %12.1f %14.1f\n", n, load_ms, lookup_ns, linear_ns, lock_ns);
+        free(keys);
+        munmap(test, test->size);
+    }
+    return 0;
+}
+
+int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Benchmark del write-ahead log: procs processi eseguono ops lock/release su vetture casuali di
+// una flotta di prova, ognuno reso duraturo prima di passare al successivo. Il log e gli snapshot
+// vengono scritti in una directory temporanea dentro quella corrente (non in /tmp, che spesso è
+// in memoria e renderebbe fdatasync gratuito)
+int walbench(int procs, long ops) {
+    char dir[] = "car-walbench-XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) == -1) {
+        perror("Error creating benchmark directory");
+        return 1;
+    }
+    test_fleet(1000);
+    open_wal();
+    uint64_t *lat = mmap(NULL, procs * ops * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (lat == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    long long start = now_ns();
+    for (int p = 0; p < procs; p++) {
+        if (fork() == 0) {
+            open_wal(); // Ogni operatore ha il suo file aperto, come processi indipendenti
+            unsigned seed = getpid();
+            for (long i = 0; i < ops; i++) {
+                int index = rand_r(&seed) % fleet->car_count;
+                uint64_t state = atomic_load(&cars[index].state);
+                long long t = now_ns();
+                int done = (state & 1) == CAR_FREE ? car_update(index, CAR_FREE, CAR_BUSY) : car_update(index, CAR_BUSY, CAR_FREE);
+                lat[p * ops + i] = done == 1 ? (uint64_t)(now_ns() - t) : UINT64_MAX; // UINT64_MAX: vettura contesa o errore
+            }
+            exit(EXIT_SUCCESS);
+        }
+    }
+    while (wait(NULL) > 0);
+    double secs = (now_ns() - start) / 1e9;
+
+    qsort(lat, procs * ops, sizeof(uint64_t), compare_u64);
+    long commits = 0;
+    while (commits < procs * ops && lat[commits] != UINT64_MAX) commits++;
+    uint64_t fsyncs = atomic_load(&fleet->fsyncs);
+    printf("Operators: %d, commits: %ld, %.0f commits/s, %.0f fsyncs/s, %.1f records per fsync\n",
+           procs, commits, commits / secs, fsyncs / secs, fsyncs ? (double)commits / fsyncs : 0.0);
+    if (commits > 0) {
+        printf("Commit latency: p50 %.1f us, p99 %.1f us, max %.1f us\n", lat[commits / 2] / 1e3,
+               lat[commits * 99 / 100] / 1e3, lat[commits - 1] / 1e3);
+    }
+
+    unlink(WAL_FILE);
+    unlink(STATE_FILE);
+    if (chdir("..") == 0) rmdir(dir);
+    return 0;
+}
+
+void buffer_reserve(Buffer *buf, size_t need) {
+    if (need <= buf->cap) return;
+    size_t cap = buf->cap ? buf->cap : 256;
+    while (cap < need) cap *= 2;  // Raddoppio la capacità per ammortizzare le realloc
+    char *data = realloc(buf->data, cap);
+    if (data == NULL) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    buf->data = data;
+    buf->cap = cap;
+}
+
+void buffer_append(Buffer *buf, const char *src, size_t n) {
+    buffer_reserve(buf, buf->len + n + 1);
+    memcpy(buf->data + buf->len, src, n);
+    buf->len += n;
+}
+
+void buffer_str(Buffer *buf, const char *str) {
+    buffer_append(buf, str, strlen(str));
+}
+
+// Funzione per alzare il limite dei file aperti al massimo consentito: server e load generator
+// tengono aperta una connessione per client
+void raise_fd_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+/*
+Server (./car serve): un solo processo, collegato alla flotta come un operatore, serve i client
+sul socket UNIX car.sock con un ciclo epoll. Il protocollo è a righe; ogni richiesta riceve una
+riga di risposta, nell'ordine delle richieste:
+  view                   -> "OK <n>" seguita da n righe "<vettura> free|busy"
+  lock <v1> [<v2> ...]   -> "OK" seguito, per ogni vettura, da locked, already_locked, unknown o
+                            error (record non scritto nel log, vettura lasciata com'era)
+  release <v1> [...]     -> "OK" seguito, per ogni vettura, da freed, already_free, unknown o error
+  quit                   -> chiude la connessione
+  altro                  -> "ERR <motivo>"
+Un client può inviare più richieste senza attendere le risposte. A ogni giro del ciclo il server
+esegue tutte le richieste complete arrivate dai client pronti, rende duraturi i loro record con
+un solo wal_commit e solo dopo invia le risposte, una write per client. Se il commit fallisce,
+tutte le risposte del giro diventano "ERR log sync failed", perché nessuna è garantita duratura,
+e i cambi di stato del giro vengono annullati come per un operatore (car_revert)
+*/
+
+typedef struct {
+    int fd;
+    Buffer in;      // Dati ricevuti, di cui l'ultima riga può essere incompleta
+    Buffer out;     // Risposte non ancora inviate, a partire da sent
+    size_t sent;
+    int closing;    // Chiudo la connessione dopo aver inviato le risposte
+    size_t round_out;     // Lunghezza di out all'inizio del giro, per sostituire le risposte se il commit fallisce
+    size_t round_requests;  // Richieste eseguite nel giro
+    uint32_t events;  // Eventi epoll registrati
+} Client;
+
+// Cambio di stato eseguito nel giro corrente, da annullare se il commit del giro fallisce
+typedef struct {
+    int index;
+    unsigned from, to;
+    uint64_t version;
+} Change;
+
+volatile sig_atomic_t stop_server = 0;
+Change *round_changes;  // Cambi di stato del giro corrente
+size_t round_count, round_cap;
+
+void on_stop_signal(int sig) {
+    (void)sig;
+    stop_server = 1;
+}
+
+// Funzione per eseguire una richiesta e aggiungere la risposta al buffer del client
+// Ritorna il ticket più alto dei record scritti nel log, 0 se nessuno
+uint64_t serve_request(Client *c, char *line, uint64_t *records) {
+    char *save, *cmd = strtok_r(line, " \t\r", &save);
+    uint64_t ticket = 0;
+    if (cmd == NULL) {
+        buffer_str(&c->out, "ERR empty request\n");
+    } else if (strcmp(cmd, "view") == 0) {
+        char head[32];
+        snprintf(head, sizeof(head), "OK %u\n", fleet->car_count);
+        buffer_str(&c->out, head);
+        for (uint32_t i = 0; i < fleet->car_count; i++) {
+            buffer_str(&c->out, car_id(i));
+            buffer_str(&c->out, (atomic_load(&cars[i].state) & 1) == CAR_BUSY ? " busy\n" : " free\n");
+        }
+    } else if (strcmp(cmd, "lock") == 0 || strcmp(cmd, "release") == 0) {
+        int locking = cmd[0] == 'l';
+        char *id = strtok_r(NULL, " \t\r", &save);
+        if (id == NULL) {
+            buffer_str(&c->out, "ERR missing car id\n");
+            return 0;
+        }
+        buffer_str(&c->out, "OK");
+        for (; id != NULL; id = strtok_r(NULL, " \t\r", &save)) {
+            int index = find_car_index(id);
+            uint64_t t = 0;
+            unsigned from = locking ? CAR_FREE : CAR_BUSY, to = locking ? CAR_BUSY : CAR_FREE;
+            uint64_t version = 0;
+            if (index != -1) t = car_log(index, from, to, &version);
+            if (t == WAL_FAILED) {
+                buffer_str(&c->out, " error");
+                continue;
+            }
+            if (t != 0) {
+                ticket = t > ticket ? t : ticket;
+                (*records)++;
+                if (round_count == round_cap) {
+                    round_cap = round_cap ? round_cap * 2 : 256;
+                    round_changes = realloc(round_changes, round_cap * sizeof(Change));
+                    if (round_changes == NULL) {
+                        perror("realloc");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                round_changes[round_count++] = (Change){ index, from, to, version };
+            }
+            buffer_str(&c->out, index == -1 ? " unknown" : t != 0 ? (locking ? " locked" : " freed")
+                                                         : (locking ? " already_locked" : " already_free"));
+        }
+        buffer_str(&c->out, "\n");
+    } else if (strcmp(cmd, "quit") == 0) {
+        c->closing = 1;
+    } else {
+        buffer_str(&c->out, "ERR unknown command\n");
+    }
+    return ticket;
+}
+
+// Funzione per aggiornare gli eventi epoll di un client: smetto di leggere se ha troppe
+// risposte in attesa, chiedo EPOLLOUT solo se ne ha
+void update_events(int ep, Client *c) {
+    size_t pending = c->out.len - c->sent;
+    uint32_t events = (pending < OUT_LIMIT && !c->closing ? EPOLLIN : 0) | (pending > 0 ? EPOLLOUT : 0);
+    if (events == c->events) return;
+    struct epoll_event ev = { .events = events, .data.ptr = c };
+    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+}
+
+void close_client(Client *c) {
+    close(c->fd); // Chiudere il descrittore lo toglie anche da epoll
+    free(c->in.data);
+    free(c->out.data);
+    free(c);
+}
+
+int serve() {
+    raise_fd_limit();
+    attach_fleet();  // Il server è un operatore come gli altri
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, SOCKET_FILE, sizeof(addr.sun_path) - 1);
+    unlink(SOCKET_FILE); // Tolgo il socket lasciato da un server precedente
+    if (listen_fd == -1 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(listen_fd, SOMAXCONN) == -1) {
+        perror("Error creating socket");
+        return 1;
+    }
+
+    struct sigaction sa = { .sa_handler = on_stop_signal }; // Senza SA_RESTART: epoll_wait ritorna EINTR
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // Un client chiuso fa fallire write con EPIPE
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL }; // NULL indica il socket in ascolto
+    epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd, &ev);
+    printf("Serving %u cars on %s\n", fleet->car_count, SOCKET_FILE);
+    fflush(stdout);
+
+    struct epoll_event events[256];
+    Client *touched[256];
+    while (!stop_server) {
+        int n = epoll_wait(ep, events, 256, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        // Eseguo le richieste di tutti i client pronti tenendo il flock condiviso sul log una volta sola
+        int count = 0;
+        uint64_t ticket = 0, records = 0;
+        round_count = 0;
+        flock(wal_fd, LOCK_SH);
+        for (int i = 0; i < n; i++) {
+            Client *c = events[i].data.ptr;
+            if (c == NULL) {
+                // Accetto tutte le connessioni in attesa
+                int fd;
+                while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                    Client *nc = calloc(1, sizeof(Client));
+                    if (nc == NULL) {
+                        close(fd);
+                        continue;
+                    }
+                    nc->fd = fd;
+                    nc->events = EPOLLIN;
+                    struct epoll_event cev = { .events = EPOLLIN, .data.ptr = nc };
+                    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev);
+                }
+                continue;
+            }
+            touched[count++] = c;
+            c->round_out = c->out.len;
+            c->round_requests = 0;
+            if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) || c->closing) continue;
+
+            // Una sola read per evento, così un client molto attivo non affama gli altri
+            buffer_reserve(&c->in, c->in.len + MAX_LINE + 1);
+            ssize_t got = read(c->fd, c->in.data + c->in.len, MAX_LINE);
+            if (got <= 0) {
+                if (got == 0 || (errno != EAGAIN && errno != EINTR)) c->closing = 1;
+                continue;
+            }
+            c->in.len += got;
+
+            // Eseguo le righe complete, nell'ordine in cui sono arrivate
+            size_t start = 0;
+            char *nl;
+            while (!c->closing && (nl = memchr(c->in.data + start, '\n', c->in.len - start)) != NULL) {
+                *nl = '\0';
+                uint64_t t = serve_request(c, c->in.data + start, &records);
+                ticket = t > ticket ? t : ticket;
+                c->round_requests++;
+                start = nl - c->in.data + 1;
+            }
+            memmove(c->in.data, c->in.data + start, c->in.len - start);
+            c->in.len -= start;
+            if (c->in.len >= MAX_LINE) {
+                buffer_str(&c->out, "ERR request too long\n");
+                c->closing = 1;
+            }
+        }
+        flock(wal_fd, LOCK_UN);
+
+        // Un solo commit per tutte le richieste del giro, poi le risposte
+        if (ticket != 0) {
+            if (wal_commit(ticket) == 0) {
+                wal_added(records);
+            } else {
+                // Nessuna risposta del giro è garantita duratura: annullo i cambi di stato e
+                // sostituisco le risposte con un errore
+                for (size_t r = 0; r < round_count; r++) {
+                    Change *ch = &round_changes[r];
+                    car_revert(ch->index, ch->from, ch->to, ch->version);
+                }
+                for (int i = 0; i < count; i++) {
+                    Client *c = touched[i];
+                    c->out.len = c->round_out;
+                    for (size_t r = 0; r < c->round_requests; r++) buffer_str(&c->out, "ERR log sync failed\n");
+                }
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            Client *c = touched[i];
+            while (c->sent < c->out.len) {
+                ssize_t w = write(c->fd, c->out.data + c->sent, c->out.len - c->sent);
+                if (w <= 0) {
+                    if (w == -1 && errno != EAGAIN && errno != EINTR) {
+                        c->closing = 1;
+                        c->sent = c->out.len; // Il client non c'è più: scarto le risposte
+                    }
+                    break;
+                }
+                c->sent += w;
+            }
+            if (c->sent == c->out.len) c->sent = c->out.len = 0;
+            if (c->closing && c->out.len == 0) close_client(c);
+            else update_events(ep, c);
+        }
+    }
+
+    close(listen_fd);
+    unlink(SOCKET_FILE);
+    quit(); // Salvo lo stato se sono l'ultimo operatore ed esco
+    return 0;
+}
+
+/*
+Load generator (./car loadgen [connessioni] [secondi] [profondità] [vetture per richiesta]):
+apre le connessioni al server e su ognuna tiene sempre "profondità" richieste in volo, lock o
+release di vetture casuali. Le risposte arrivano nell'ordine delle richieste, quindi per ogni
+connessione basta una coda degli istanti di invio per misurare la latenza di ciascuna. Senza il
+numero di connessioni esegue in sequenza 1, 10, 100 e 1000 connessioni
+*/
+
+typedef struct {
+    int fd;
+    Buffer in, out;
+    size_t sent;
+    long long *times;   // Istanti di invio delle richieste in volo, coda circolare
+    int head, inflight;
+} Conn;
+
+char **bench_ids;       // Identificativi delle vetture, letti con view
+uint32_t bench_count;
+
+int connect_server() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, SOCKET_FILE, sizeof(addr.sun_path) - 1);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("Error connecting to server");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// Funzione per leggere l'elenco delle vetture dal server con view
+void load_bench_ids() {
+    int fd = connect_server();
+    FILE *f = fdopen(fd, "r+");
+    fprintf(f, "view\n");
+    fflush(f);
+    if (fscanf(f, "OK %u\n", &bench_count) != 1 || bench_count == 0) {
+        fprintf(stderr, "Unexpected answer to view\n");
+        exit(EXIT_FAILURE);
+    }
+    bench_ids = malloc(bench_count * sizeof(char *));
+    char id[MAX_ID_LEN + 2], status[10];
+    for (uint32_t i = 0; i < bench_count; i++) {
+        if (fscanf(f, "%64s %9s", id, status) != 2) exit(EXIT_FAILURE);
+        bench_ids[i] = strdup(id);
+    }
+    fprintf(f, "quit\n");
+    fclose(f);
+}
+
+// Funzione per accodare una richiesta sulla connessione e registrare l'istante di invio
+void send_request(Conn *c, int depth, int batch, unsigned *seed) {
+    buffer_str(&c->out, rand_r(seed) % 2 ? "lock" : "release");
+    for (int b = 0; b < batch; b++) {
+        buffer_str(&c->out, " ");
+        buffer_str(&c->out, bench_ids[rand_r(seed) % bench_count]);
+    }
+    buffer_str(&c->out, "\n");
+    c->times[(c->head + c->inflight) % depth] = now_ns();
+    c->inflight++;
+}
+
+void flush_conn(int ep, Conn *c) {
+    while (c->sent < c->out.len) {
+        ssize_t w = write(c->fd, c->out.data + c->sent, c->out.len - c->sent);
+        if (w <= 0) break;
+        c->sent += w;
+    }
+    if (c->sent == c->out.len) c->sent = c->out.len = 0;
+    struct epoll_event ev = { .events = EPOLLIN | (c->out.len ? EPOLLOUT : 0), .data.ptr = c };
+    epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// Esegue un livello del load generator e stampa una riga di risultati
+void loadgen_level(int conns, double secs, int depth, int batch) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    Conn *all = calloc(conns, sizeof(Conn));
+    unsigned seed = 1;
+    for (int i = 0; i < conns; i++) {
+        Conn *c = &all[i];
+        c->fd = connect_server();
+        fcntl(c->fd, F_SETFL, O_NONBLOCK);
+        c->times = malloc(depth * sizeof(long long));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev);
+    }
+
+    Buffer lat = {0}; // Latenze in nanosecondi, come array di uint64_t
+    long long start = now_ns(), end = start + (long long)(secs * 1e9);
+    for (int i = 0; i < conns; i++) {
+        for (int d = 0; d < depth; d++) send_request(&all[i], depth, batch, &seed);
+        flush_conn(ep, &all[i]);
+    }
+
+    struct epoll_event events[256];
+    long long now = start;
+    long errors = 0;
+    while (now < end) {
+        int n = epoll_wait(ep, events, 256, 100);
+        now = now_ns();
+        for (int i = 0; i < n; i++) {
+            Conn *c = events[i].data.ptr;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                buffer_reserve(&c->in, c->in.len + 65536);
+                ssize_t got = read(c->fd, c->in.data + c->in.len, 65536);
+                if (got == 0 || (got == -1 && errno != EAGAIN)) {
+                    fprintf(stderr, "Server closed the connection\n");
+                    exit(EXIT_FAILURE);
+                }
+                if (got > 0) c->in.len += got;
+            }
+            // Ogni riga completa è la risposta alla richiesta in volo più vecchia
+            size_t startl = 0;
+            char *nl;
+            while ((nl = memchr(c->in.data + startl, '\n', c->in.len - startl)) != NULL) {
+                if (c->in.data[startl] != 'O') errors++;
+                uint64_t l = now - c->times[c->head];
+                buffer_append(&lat, (char *)&l, sizeof(l));
+                c->head = (c->head + 1) % depth;
+                c->inflight--;
+                startl = nl - c->in.data + 1;
+                if (now < end) send_request(c, depth, batch, &seed);
+            }
+            memmove(c->in.data, c->in.data + startl, c->in.len - startl);
+            c->in.len -= startl;
+            flush_conn(ep, c);
+        }
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    for (int i = 0; i < conns; i++) {
+        close(all[i].fd);
+        free(all[i].in.data);
+        free(all[i].out.data);
+        free(all[i].times);
+    }
+    free(all);
+    close(ep);
+
+    uint64_t *l = (uint64_t *)lat.data;
+    size_t done = lat.len / sizeof(uint64_t);
+    if (done == 0) {
+        printf("%6d %6d %6d %10d\n", conns, depth, batch, 0);
+        return;
+    }
+    qsort(l, done, sizeof(uint64_t), compare_u64);
+    printf("%6d %6d %6d %10zu %10.0f %9.1f %9.1f %9.1f %9.1f %7ld\n", conns, depth, batch, done, done / elapsed,
+           l[done / 2] / 1e3, l[done * 99 / 100] / 1e3, l[done * 999 / 1000] / 1e3, l[done - 1] / 1e3, errors);
+    free(lat.data);
+}
+
+int loadgen(int conns, double secs, int depth, int batch) {
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+    load_bench_ids();
+    printf("%6s %6s %6s %10s %10s %9s %9s %9s %9s %7s\n", "conns", "depth", "batch", "requests", "req/s",
+           "p50_us", "p99_us", "p999_us", "max_us", "errors");
+    if (conns > 0) {
+        loadgen_level(conns, secs, depth, batch);
+    } else {
+        int levels[] = {1, 10, 100, 1000};
+        for (int i = 0; i < 4; i++) loadgen_level(levels[i], secs, depth, batch);
+    }
+    return 0;
+}
+
+/*
+Benchmark di contesa (./car contention). Ogni operatore ripete per la durata del test: sceglie
+una vettura (in modo uniforme o con distribuzione Zipf, che concentra le richieste su poche
+vetture), prova a noleggiarla e, se ci riesce, la rilascia subito. Lo stesso carico viene
+eseguito con quattro meccanismi:
+  sem     un semaforo nominato per vettura che protegge lo stato, come nella versione originale
+          (i semafori sono aperti una volta sola per processo, non a ogni comando)
+  global  un solo mutex condiviso fra processi per tutta la flotta
+  futex   un lock per vettura costruito su futex
+  cas     lo stato atomico cambiato con compare-and-swap, come fa car.c
+Le latenze finiscono in istogrammi log-lineari (come HDR histogram): per ogni potenza di due
+HIST_SUB sottointervalli, quindi errore relativo inferiore al 7% con memoria fissa
+*/
+
+#define HIST_SUB 16
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total, max;
+} Histogram;
+
+// Indice del sottointervallo che contiene v
+int hist_bucket(uint64_t v) {
+    if (v < HIST_SUB) return v;
+    int exp = 63 - __builtin_clzll(v);                    // v è in [2^exp, 2^(exp+1))
+    int sub = (v >> (exp - 4)) & (HIST_SUB - 1);          // 4 = log2(HIST_SUB)
+    return (exp - 3) * HIST_SUB + sub;
+}
+
+// Limite inferiore del sottointervallo b, cioè il valore riportato per i percentili
+uint64_t hist_value(int b) {
+    if (b < 2 * HIST_SUB) return b;
+    int exp = b / HIST_SUB + 3;
+    return ((uint64_t)HIST_SUB + b % HIST_SUB) << (exp - 4);
+}
+
+void hist_record(Histogram *h, uint64_t v) {
+    h->counts[hist_bucket(v)]++;
+    h->total++;
+    if (v > h->max) h->max = v;
+}
+
+uint64_t hist_percentile(const Histogram *h, double p) {
+    uint64_t rank = (uint64_t)(p * h->total), seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen > rank) return hist_value(b);
+    }
+    return h->max;
+}
+
+// Sommo l'istogramma di un figlio a quello condiviso
+void hist_merge(Histogram *dst, const Histogram *src) {
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        if (src->counts[b]) __atomic_fetch_add(&dst->counts[b], src->counts[b], __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&dst->total, src->total, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&dst->max, __ATOMIC_RELAXED);
+    while (src->max > max && !__atomic_compare_exchange_n(&dst->max, &max, src->max, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+enum { SYNC_SEM, SYNC_GLOBAL, SYNC_FUTEX, SYNC_CAS };
+const char *sync_names[] = {"sem", "global", "futex", "cas"};
+
+// Stato di una vettura per i meccanismi basati su lock: il lock protegge status
+typedef struct {
+    atomic_int futex;   // 0 libero, 1 preso, 2 preso con processi in attesa
+    unsigned status;
+} LockedCar;
+
+// Memoria condivisa fra gli operatori del benchmark
+typedef struct {
+    pthread_mutex_t global;
+    Histogram lock_hist, release_hist;
+} ContentionShared;
+
+long futex(atomic_int *addr, int op, int val) {
+    return syscall(SYS_futex, addr, op, val, NULL, NULL, 0); // Non privato: il lock è fra processi
+}
+
+// Lock su futex a tre stati (Drepper, "Futexes Are Tricky")
+void futex_lock(atomic_int *f) {
+    int c = 0;
+    if (atomic_compare_exchange_strong(f, &c, 1)) return; // Caso senza contesa: nessuna system call
+    if (c != 2) c = atomic_exchange(f, 2);
+    while (c != 0) {
+        futex(f, FUTEX_WAIT, 2);
+        c = atomic_exchange(f, 2);
+    }
+}
+
+void futex_unlock(atomic_int *f) {
+    if (atomic_exchange(f, 0) == 2) futex(f, FUTEX_WAKE, 1); // Sveglio solo se qualcuno aspetta
+}
+
+// Generatore xorshift64*, uno per processo
+uint64_t next_random(uint64_t *x) {
+    *x ^= *x >> 12;
+    *x ^= *x << 25;
+    *x ^= *x >> 27;
+    return *x * 0x2545F4914F6CDD1DULL;
+}
+
+// Sceglie una vettura: uniforme senza cdf, altrimenti Zipf con ricerca binaria sulla distribuzione cumulata
+int pick_car(const double *cdf, int n, uint64_t *rnd) {
+    uint64_t r = next_random(rnd);
+    if (cdf == NULL) return r % n;
+    double u = (r >> 11) * (1.0 / 9007199254740992.0);
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Ciclo di un operatore per un meccanismo. Ritorna quando scade il tempo
+void contention_worker(int sync, int n, const double *cdf, long long end, ContentionShared *shared,
+                       LockedCar *locked, sem_t **sems) {
+    Histogram *lock_hist = calloc(1, sizeof(Histogram)), *release_hist = calloc(1, sizeof(Histogram));
+    uint64_t rnd = getpid() * 0x9E3779B97F4A7C15ULL | 1;
+    long long now = now_ns();
+    while (now < end) {
+        int i = pick_car(cdf, n, &rnd);
+        int got = 0;
+        long long t = now_ns();
+        switch (sync) {
+            case SYNC_SEM:
+                sem_wait(sems[i]);
+                if (locked[i].status == CAR_FREE) locked[i].status = CAR_BUSY, got = 1;
+                sem_post(sems[i]);
+                break;
+            case SYNC_GLOBAL:
+                pthread_mutex_lock(&shared->global);
+                if (locked[i].status == CAR_FREE) locked[i].status = CAR_BUSY, got = 1;
+                pthread_mutex_unlock(&shared->global);
+                break;
+            case SYNC_FUTEX:
+                futex_lock(&locked[i].futex);
+                if (locked[i].status == CAR_FREE) locked[i].status = CAR_BUSY, got = 1;
+                futex_unlock(&locked[i].futex);
+                break;
+            case SYNC_CAS:
+                got = car_transition(&cars[i], CAR_FREE, CAR_BUSY) != 0;
+                break;
+        }
+        now = now_ns();
+        hist_record(lock_hist, now - t);
+        if (!got) continue;
+
+        t = now;
+        switch (sync) {
+            case SYNC_SEM:
+                sem_wait(sems[i]);
+                locked[i].status = CAR_FREE;
+                sem_post(sems[i]);
+                break;
+            case SYNC_GLOBAL:
+                pthread_mutex_lock(&shared->global);
+                locked[i].status = CAR_FREE;
+                pthread_mutex_unlock(&shared->global);
+                break;
+            case SYNC_FUTEX:
+                futex_lock(&locked[i].futex);
+                locked[i].status = CAR_FREE;
+                futex_unlock(&locked[i].futex);
+                break;
+            case SYNC_CAS:
+                car_transition(&cars[i], CAR_BUSY, CAR_FREE);
+                break;
+        }
+        now = now_ns();
+        hist_record(release_hist, now - t);
+    }
+    hist_merge(&shared->lock_hist, lock_hist);
+    hist_merge(&shared->release_hist, release_hist);
+}
+
+void print_hist_row(const char *sync, const char *dist, const char *op, const Histogram *h, double secs) {
+    printf("%-7s %-8s %-8s %10llu %11.0f %8llu %8llu %8llu %9llu %10llu\n", sync, dist, op,
+           (unsigned long long)h->total, h->total / secs, (unsigned long long)hist_percentile(h, 0.5),
+           (unsigned long long)hist_percentile(h, 0.9), (unsigned long long)hist_percentile(h, 0.99),
+           (unsigned long long)hist_percentile(h, 0.999), (unsigned long long)h->max);
+}
+
+int contention(int procs, int n, double secs, double zipf_s) {
+    // Distribuzione cumulata di Zipf: la vettura di rango k ha peso 1 / k^s
+    double *cdf = malloc(n * sizeof(double)), sum = 0;
+    for (int k = 0; k < n; k++) sum += 1.0 / pow(k + 1, zipf_s);
+    double acc = 0;
+    for (int k = 0; k < n; k++) cdf[k] = (acc += 1.0 / pow(k + 1, zipf_s) / sum);
+    cdf[n - 1] = 1.0;
+
+    ContentionShared *shared = mmap(NULL, sizeof(ContentionShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    LockedCar *locked = mmap(NULL, n * sizeof(LockedCar), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED || locked == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&shared->global, &attr);
+    test_fleet(n);
+
+    // Semafori nominati, uno per vettura, aperti prima della fork e quindi ereditati dai figli.
+    // Ogni semaforo aperto è una mappatura: con flotte grandi si supera vm.max_map_count
+    sem_t **sems = malloc(n * sizeof(sem_t *));
+    int opened = 0;
+    char name[64];
+    for (; opened < n; opened++) {
+        snprintf(name, sizeof(name), "/car_contention_%d_%d", getpid(), opened);
+        sems[opened] = sem_open(name, O_CREAT | O_EXCL, 0600, 1);
+        if (sems[opened] == SEM_FAILED) {
+            perror("Error creating semaphore, skipping sem");
+            break;
+        }
+        sem_unlink(name); // Il semaforo resta valido finché è aperto
+    }
+
+    printf("Operators: %d, cars: %d, %.1f s per run, zipf exponent %.2f (latencies in ns)\n", procs, n, secs, zipf_s);
+    printf("%-7s %-8s %-8s %10s %11s %8s %8s %8s %9s %10s\n", "sync", "dist", "op", "count", "ops/s",
+           "p50", "p90", "p99", "p99.9", "max");
+    for (int sync = opened == n ? SYNC_SEM : SYNC_GLOBAL; sync <= SYNC_CAS; sync++) {
+        for (int zipf = 0; zipf <= 1; zipf++) {
+            memset(&shared->lock_hist, 0, sizeof(Histogram));
+            memset(&shared->release_hist, 0, sizeof(Histogram));
+            fflush(stdout); // Altrimenti i figli ereditano e ristampano le righe ancora nel buffer
+            long long end = now_ns() + (long long)(secs * 1e9);
+            for (int p = 0; p < procs; p++) {
+                if (fork() == 0) {
+                    contention_worker(sync, n, zipf ? cdf : NULL, end, shared, locked, sems);
+                    exit(EXIT_SUCCESS);
+                }
+            }
+            while (wait(NULL) > 0);
+            const char *dist = zipf ? "zipf" : "uniform";
+            print_hist_row(sync_names[sync], dist, "lock", &shared->lock_hist, secs);
+            print_hist_row(sync_names[sync], dist, "release", &shared->release_hist, secs);
+        }
+    }
+    for (int i = 0; i < opened; i++) sem_close(sems[i]);
+    free(sems);
+    free(cdf);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "stress") == 0) {
+        return stress(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atol(argv[3]) : 1000000);
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return bench();
+    }
+    if (argc > 1 && strcmp(argv[1], "walbench") == 0) {
+        return walbench(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atol(argv[3]) : 2000);
+    }
+    if (argc > 1 && strcmp(argv[1], "contention") == 0) {
+        int procs = argc > 2 ? atoi(argv[2]) : 8, n = argc > 3 ? atoi(argv[3]) : 1000;
+        return contention(procs > 0 ? procs : 1, n > 0 ? n : 1, argc > 4 ? atof(argv[4]) : 2, argc > 5 ? atof(argv[5]) : 0.99);
+    }
+    if (argc > 1 && strcmp(argv[1], "serve") == 0) {
+        return serve();
+    }
+    if (argc > 1 && strcmp(argv[1], "loadgen") == 0) {
+        int depth = argc > 4 ? atoi(argv[4]) : 1, batch = argc > 5 ? atoi(argv[5]) : 1;
+        return loadgen(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atof(argv[3]) : 3, depth > 0 ? depth : 1, batch > 0 ? batch : 1);
+    }
+
+    attach_fleet();  // Mi collego alla flotta condivisa, creandola se sono il primo operatore
 
     char command[100]; // Array per memorizzare il comando inserito dall'utente
-    char car_id[20]; // Array per memorizzare l'identificativo della vettura inserito dall'utente
+    char id[MAX_ID_LEN + 1]; // Array per memorizzare l'identificativo della vettura inserito dall'utente
 
     while (1) { // Ciclo infinito per attendere comandi dall'utente
         printf("Command: "); // Stampo il prompt del comando
-        scanf("%s", command); // Leggo il comando dall'utente
-
+        if (scanf("%99s", command) != 1) quit(); // Leggo il comando dall'utente; a fine input esco come con quit
         // Verifico quale comando è stato inserito e chiamo la funzione corrispondente
         if (strcmp(command, "view") == 0) { // Se il comando è "view"
             view(); // Chiamo la funzione view
         } else if (strcmp(command, "lock") == 0) { // Se il comando è "lock"
-            scanf("%s", car_id); // Leggo l'identificativo della vettura dall'utente
-            lock(car_id); // Chiamo la funzione lock
+            if (scanf("%63s", id) != 1) quit(); // Leggo l'identificativo della vettura dall'utente
+            lock(id); // Chiamo la funzione lock
         } else if (strcmp(command, "release") == 0) { // Se il comando è "release"
-            scanf("%s", car_id); // Leggo l'identificativo della vettura dall'utente
-            release(car_id); // Chiamo la funzione release
+            if (scanf("%63s", id) != 1) quit(); // Leggo l'identificativo della vettura dall'utente
+            release(id); // Chiamo la funzione release
         } else if (strcmp(command, "quit") == 0) { // Se il comando è "quit"
             quit(); // Chiamo la funzione quit
         } else { // Se il comando è sconosciuto
@@ -0,0 +1,87 @@
+# Benchmark per container-run.sh.
+# Misura il tempo di avvio di un container che esegue un comando banale (di default /bin/true),
+# a freddo (cache dei rootfs vuota a ogni esecuzione), a caldo (rootfs già preparato) e a caldo
+# senza hardlink (CONTAINER_NO_HARDLINK=1: reflink o copia), con <runs> esecuzioni per caso
+# (default 20). La configurazione di default contiene alcuni binari comuni di /bin; se ne può
+# passare una propria.
+# La cache è in $BENCH_CACHE, di default accanto a quella usata da container-run.sh, così il
+# filesystem è lo stesso della configurazione di default; lo script stampa anche quale metodo
+# (reflink, hardlink o copia) vi è disponibile.
+# Se un'esecuzione fallisce (container-run.sh esce con lo stato del comando) il benchmark si
+# interrompe e ne stampa l'output, invece di riportare i tempi di esecuzioni non riuscite.
+#
+# Esempio di utilizzo:
+# ./container-bench.sh 50
+# ./container-bench.sh 20 conf-file.txt /bin/ls /
+
+#!/bin/bash
+
+CONTAINER=${CONTAINER:-./container-run.sh}
+RUNS=${1:-20}
+CONF=$2
+DEFAULT_CACHE=${CONTAINER_CACHE:-${XDG_CACHE_HOME:-$HOME/.cache}/container-run}
+mkdir -p "$(dirname "$DEFAULT_CACHE")"
+WORKDIR=$(mktemp -d "${BENCH_CACHE:-$(dirname "$DEFAULT_CACHE")}/container-bench-XXXXXX")
+trap 'rm -rf "$WORKDIR"' EXIT
+shift 2 2> /dev/null
+COMMAND=("${@:-/bin/true}")
+
+# Tempo trascorso in secondi (con millisecondi) dall'istante passato come argomento
+elapsed() {
+    local start="$1"
+    local now=$(date +%s.%N)
+    awk -v a="$start" -v b="$now" 'BEGIN { printf "%.3f", b - a }'
+}
+
+if [ -z "$CONF" ]; then
+    CONF="$WORKDIR/conf.txt"
+    for bin in /bin/true /bin/sh /bin/ls /bin/cat /bin/grep /bin/sed; do
+        [ -f "$bin" ] && echo "$bin $bin"
+    done > "$CONF"
+fi
+
+# Metodo con cui container-run.sh può popolare la directory di lavoro su questo filesystem
+link_method() {
+    echo > "$WORKDIR/probe"
+    if cp --reflink=always "$WORKDIR/probe" "$WORKDIR/probe.reflink" 2> /dev/null; then
+        echo reflink
+    elif ln "$WORKDIR/probe" "$WORKDIR/probe.link" 2> /dev/null; then
+        echo hardlink
+    else
+        echo copy
+    fi
+    rm -f "$WORKDIR"/probe*
+}
+
+# Esecuzione di un container con la cache in $WORKDIR/cache; esco se fallisce, altrimenti i
+# tempi misurerebbero esecuzioni non riuscite
+run_once() {
+    CONTAINER_CACHE="$WORKDIR/cache" CONTAINER_NO_HARDLINK=$1 \
+        bash "$CONTAINER" "$CONF" "${COMMAND[@]}" > "$WORKDIR/output" 2>&1
+    local status=$?
+    if [ "$status" -ne 0 ]; then
+        echo "Error: container run failed (exit $status):"
+        cat "$WORKDIR/output"
+        exit 1
+    fi
+}
+
+# Esecuzioni in sequenza; cold svuota la cache prima di ognuna
+run() {
+    local mode="$1"
+    local no_hardlink=
+    [ "$mode" = warm-no-hardlink ] && no_hardlink=1
+    local start=$(date +%s.%N)
+    for ((i = 0; i < RUNS; i++)); do
+        [ "$mode" = cold ] && rm -rf "$WORKDIR/cache"
+        run_once "$no_hardlink"
+    done
+    local t=$(elapsed "$start")
+    echo "$mode: $t s, $(awk -v t="$t" -v n="$RUNS" 'BEGIN { printf "%.1f", t * 1000 / n }') ms/start"
+}
+
+echo "Cache: $WORKDIR, populate method: $(link_method)"
+run cold
+run_once
+run warm
+run warm-no-hardlink
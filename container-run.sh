@@ -12,6 +12,26 @@
 # Esempio di utilizzo:
 # ./container-run.sh conf-file.txt /bin/ls -lh /lib
 
+# Cache dei rootfs (in $CONTAINER_CACHE, di default ~/.cache/container-run):
+# - objects/<sha256>: contenuto di ogni binario e libreria copiati, una sola volta anche se
+#   condivisi da più binari o più configurazioni
+# - index: per ogni file sorgente la chiave "dispositivo:inode:mtime:dimensione" e il suo sha256,
+#   così un file già visto non viene riletto
+# - deps/<chiave>: librerie trovate da ldd per un binario, con le loro chiavi, per non rieseguire
+#   ldd finché nessuna di queste cambia (un aggiornamento può aggiungere dipendenze)
+# - rootfs/<hash>/root: rootfs già preparato per una configurazione (hash del contenuto del file
+#   e della directory corrente), con i file collegati agli objects; rootfs/<hash>/manifest contiene
+#   le chiavi di tutti i file sorgente ed è valido finché nessuno di questi cambia
+# A ogni esecuzione la directory di lavoro (creata dentro la cache, così è sullo stesso
+# filesystem) viene popolata dal rootfs preparato con reflink o hardlink, o con una copia se il
+# filesystem non li supporta; il rootfs si ricostruisce solo se la configurazione o uno dei file
+# è cambiato.
+# Attenzione: con gli hardlink i file del container sono gli stessi inode degli objects. Gli
+# objects sono in sola lettura, ma il programma nel container gira con l'utente proprietario e
+# può rimetterli in scrittura con chmod e modificarli, corrompendo ogni rootfs che li condivide.
+# Per programmi che possono scrivere sui propri binari o librerie si imposti
+# CONTAINER_NO_HARDLINK=1: la directory viene popolata solo con reflink o copie.
+
 
 
 #!/bin/bash
@@ -27,10 +47,15 @@ CONF_FILE=$1
 shift # rimuovo il primo argomento
 COMMAND=("$@") # array di argomenti \{shift}
 
+CACHE_DIR=${CONTAINER_CACHE:-${XDG_CACHE_HOME:-$HOME/.cache}/container-run}
+mkdir -p "$CACHE_DIR/objects" "$CACHE_DIR/deps" "$CACHE_DIR/rootfs"
+if [ $? -ne 0 ]; then
+    echo "Errore: impossibile creare la cache $CACHE_DIR"
+    exit 1
+fi
 
-# Creo directory temporanea
-WORKDIR="/tmp/container-$(date +%s)-$$" # Uso data e PID script
-mkdir -p "$WORKDIR"
+# Creo directory temporanea nella cache: hardlink e reflink funzionano solo sullo stesso filesystem
+WORKDIR=$(mktemp -d "$CACHE_DIR/run-XXXXXX")
 STATUS=$? # Variabile di controllo
 
 
@@ -43,21 +68,6 @@ fi
 # Array per tenere traccia delle directory montate
 MOUNTED_DIRS=()
 
-# Funzione per copiare le librerie necessarie
-# Prendo binario e directory di destinazione
-copy_libs() {
-    local bin="$1"
-    local dest_dir="$2"
-    mkdir -p "$dest_dir"
-
-    # Uso ldd per trovare lib necessarie al binario e le copio
-    for lib in $(ldd "$bin" | awk '{print $3}' | grep -v '('); do
-        local lib_dir=$(dirname "$lib")
-        mkdir -p "$dest_dir/$lib_dir"
-        cp "$lib" "$dest_dir/$lib_dir"
-    done
-}
-
 # Funzione per pulire la directory temporanea al termine
 cleanup() {
     echo "Pulizia della directory temporanea"
@@ -74,90 +84,188 @@ cleanup() {
 }
 trap cleanup EXIT # Chiamo cleanup anche se fallisco
 
-# Imposto il separatore di campo interno (IFS) al carattere newline
-IFS=$'\n'
-
-# Leggo il file di configurazione e creo i bind mounts o copio i file e le librerie necessarie
-while read -r line; do
-    ORIGIN=$(echo "$line" | awk '{print $1}') # estraggo percorso origine con awk
-    DST=$(echo "$line" | awk '{print $2}') # estraggo percorso destinazione con awk
-    DST_DIR="$WORKDIR/$(dirname "$DST")" # creo e poi sostituisco percorso WORKDIR
-
-
-    # Creo la directory di destinazione se non esiste
-    mkdir -p "$DST_DIR"
-
-
-
-
-     # Se ORIGIN e' directory uso bindfs per montarla
+# Leggo il file di configurazione: i file vanno nel rootfs preparato, le directory vengono montate
+# a ogni esecuzione
+CONF_LINES=()
+FILE_SRC=()
+FILE_DST=()
+DIR_SRC=()
+DIR_DST=()
+while IFS=$' \t' read -r ORIGIN DST _; do
+    [ -z "$ORIGIN" ] && continue
+    CONF_LINES+=("$ORIGIN $DST")
     if [ -d "$ORIGIN" ]; then
-      # Gestisco "fuse: mountpoint is not empty"
-      if mountpoint -q "$WORKDIR/$DST"; then
-        echo "Il mount point $WORKDIR/$DST non è vuoto, continuando con --nonempty"
-      else
-        mkdir -p "$WORKDIR/$DST" # Per assicurarmi che esista
-      fi
-
-      bindfs --no-allow-other --nonempty "$ORIGIN" "$WORKDIR/$DST"
-      MOUNTED_DIRS+=("$WORKDIR/$DST") # Aggiunte per pulizia succesiva
-
-    # Se file copio
+        DIR_SRC+=("$ORIGIN")
+        DIR_DST+=("$DST")
     elif [ -f "$ORIGIN" ]; then
-
-        cp "$ORIGIN" "$WORKDIR/$DST"
-        copy_libs "$ORIGIN" "$WORKDIR"
-
-    # Altrimenti
+        FILE_SRC+=("$ORIGIN")
+        FILE_DST+=("$DST")
     else
         echo "Errore: origine $ORIGIN non trovata"
         exit 1
     fi
 done < "$CONF_FILE" # Prendo input per while da CONF_FILE
 
+# Chiave di ogni file: cambia se il file viene sostituito (inode) o modificato (mtime, dimensione)
+stat_keys() {
+    [ "$#" -gt 0 ] || return 0
+    stat -L -c '%d:%i:%.9Y:%s %n' -- "$@"
+}
 
-# Eseguo il comando specificato nel container con fakechroot
-echo "Eseguendo fakechroot chroot $WORKDIR ${COMMAND[@]}"
-fakechroot chroot "$WORKDIR" "${COMMAND[@]}"
-
-# Evito la chiamata ridondante a cleanup
-trap - EXIT
-cleanup
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+# Un elenco di chiavi (manifest di un rootfs o deps di un binario) è valido se le chiavi dei file
+# sono ancora quelle salvate
+keys_valid() {
+    local manifest="$1"
+    [ -f "$manifest" ] || return 1
+    local lines paths=()
+    mapfile -t lines < "$manifest"
+    for line in "${lines[@]}"; do paths+=("${line#* }"); done
+    [ "$(stat_keys "${paths[@]}" 2> /dev/null)" == "$(printf '%s\n' "${lines[@]}")" ]
+}
 
+# Librerie di un binario secondo ldd, come percorsi assoluti
+resolve_libs() {
+    local name arrow lib rest
+    ldd "$1" 2> /dev/null | while read -r name arrow lib rest; do
+        if [ "$arrow" == "=>" ] && [[ $lib == /* ]]; then
+            echo "$lib"
+        fi
+    done
+}
 
+# Funzione per preparare il rootfs della configurazione in $1 (chiamata con il lock esclusivo)
+build_rootfs() {
+    local rootfs="$1"
+    local -A entries=() keys=() sums=() index=()
+    local i src dst key sum path libs lib_key
+
+    # Chiavi dei binari: servono per trovare le loro librerie in deps
+    local bin_keys
+    mapfile -t bin_keys < <(stat_keys "${FILE_SRC[@]}")
+
+    # Ogni destinazione compare una sola volta: le librerie condivise fra più binari si copiano una volta
+    for i in "${!FILE_SRC[@]}"; do
+        src="${FILE_SRC[$i]}"
+        entries["${FILE_DST[$i]}"]="$src"
+        key="${bin_keys[$i]%% *}"
+        if ! keys_valid "$CACHE_DIR/deps/$key"; then
+            mapfile -t libs < <(resolve_libs "$src")
+            stat_keys "${libs[@]}" > "$CACHE_DIR/deps/$key.$$"
+            mv "$CACHE_DIR/deps/$key.$$" "$CACHE_DIR/deps/$key"
+        fi
+        while read -r lib_key path; do
+            entries["$path"]="$path"
+        done < "$CACHE_DIR/deps/$key"
+    done
 
+    # Chiavi di tutti i file sorgente con un solo stat
+    local sources=() line
+    mapfile -t sources < <(printf '%s\n' "${entries[@]}" | sort -u)
+    local manifest
+    mapfile -t manifest < <(stat_keys "${sources[@]}")
+    for line in "${manifest[@]}"; do keys["${line#* }"]="${line%% *}"; done
 
+    # sha256 dei file già visti dall'index, degli altri con un solo sha256sum
+    if [ -f "$CACHE_DIR/index" ]; then
+        while read -r key sum; do index["$key"]="$sum"; done < "$CACHE_DIR/index"
+    fi
+    local missing=()
+    for src in "${sources[@]}"; do
+        sum="${index[${keys[$src]}]}"
+        if [ -n "$sum" ] && [ -f "$CACHE_DIR/objects/$sum" ]; then
+            sums["$src"]="$sum"
+        else
+            missing+=("$src")
+        fi
+    done
+    if [ "${#missing[@]}" -gt 0 ]; then
+        while read -r sum path; do
+            src="${path#\*}"  # sha256sum può prefissare il nome con '*'
+            sums["$src"]="$sum"
+            if [ ! -f "$CACHE_DIR/objects/$sum" ]; then
+                cp --reflink=auto "$src" "$CACHE_DIR/objects/$sum.$$" &&
+                    chmod a-w "$CACHE_DIR/objects/$sum.$$" &&
+                    mv "$CACHE_DIR/objects/$sum.$$" "$CACHE_DIR/objects/$sum"
+            fi
+            echo "${keys[$src]} $sum" >> "$CACHE_DIR/index"
+        done < <(sha256sum -- "${missing[@]}")
+    fi
 
+    # Costruisco il nuovo rootfs a parte e lo sostituisco al vecchio solo alla fine
+    local tmp="$rootfs.tmp-$$"
+    rm -rf "$tmp"
+    local dirs=("$tmp/root")
+    for dst in "${!entries[@]}"; do dirs+=("$tmp/root/$(dirname "$dst")"); done
+    for dst in "${DIR_DST[@]}"; do dirs+=("$tmp/root/$dst"); done
+    mkdir -p "${dirs[@]}" || return 1
+    for dst in "${!entries[@]}"; do
+        local object="$CACHE_DIR/objects/${sums[${entries[$dst]}]}"
+        ln -f "$object" "$tmp/root/$dst" 2> /dev/null || cp --reflink=auto "$object" "$tmp/root/$dst" || return 1
+    done
+    printf '%s\n' "${manifest[@]}" > "$tmp/manifest"
+    rm -rf "$rootfs"
+    mv "$tmp" "$rootfs"
+}
 
+# Funzione per popolare la directory di lavoro dal rootfs preparato: reflink, poi hardlink
+# (se non disabilitati con CONTAINER_NO_HARDLINK), poi copia
+populate() {
+    local root="$1"
+    local modes=(--reflink=always --link --reflink=auto)
+    [ -n "$CONTAINER_NO_HARDLINK" ] && modes=(--reflink=always --reflink=auto)
+    for mode in "${modes[@]}"; do
+        cp -a "$mode" "$root/." "$WORKDIR" 2> /dev/null && return 0
+        rm -rf "$WORKDIR" && mkdir -p "$WORKDIR"
+    done
+    return 1
+}
 
+# Il rootfs dipende dal contenuto della configurazione e dalla directory corrente (i percorsi
+# relativi cambiano significato)
+read -r CONF_HASH _ < <(printf '%s\n' "$PWD" "${CONF_LINES[@]}" | sha256sum)
+ROOTFS="$CACHE_DIR/rootfs/$CONF_HASH"
+
+# Lock condiviso per usare il rootfs, esclusivo per ricostruirlo
+exec {LOCK_FD}> "$CACHE_DIR/lock"
+flock -s "$LOCK_FD"
+if ! keys_valid "$ROOTFS/manifest"; then
+    flock -u "$LOCK_FD"
+    flock "$LOCK_FD"
+    # Un'altra esecuzione può averlo ricostruito mentre aspettavo il lock
+    if ! keys_valid "$ROOTFS/manifest" && ! build_rootfs "$ROOTFS"; then
+        echo "Errore: impossibile preparare il rootfs in $ROOTFS"
+        exit 1
+    fi
+fi
+if ! populate "$ROOTFS/root"; then
+    echo "Errore: impossibile popolare $WORKDIR"
+    exit 1
+fi
+flock -u "$LOCK_FD"
+exec {LOCK_FD}>&-
+
+# Monto le directory con bindfs
+for i in "${!DIR_SRC[@]}"; do
+    ORIGIN="${DIR_SRC[$i]}"
+    DST="${DIR_DST[$i]}"
+    # Gestisco "fuse: mountpoint is not empty"
+    if mountpoint -q "$WORKDIR/$DST"; then
+      echo "Il mount point $WORKDIR/$DST non è vuoto, continuando con --nonempty"
+    else
+      mkdir -p "$WORKDIR/$DST" # Per assicurarmi che esista
+    fi
 
+    bindfs --no-allow-other --nonempty "$ORIGIN" "$WORKDIR/$DST"
+    MOUNTED_DIRS+=("$WORKDIR/$DST") # Aggiunte per pulizia succesiva
+done
 
 
+# Eseguo il comando specificato nel container con fakechroot
+echo "Eseguendo fakechroot chroot $WORKDIR ${COMMAND[@]}"
+fakechroot chroot "$WORKDIR" "${COMMAND[@]}"
+COMMAND_STATUS=$? # Lo script esce con lo stato del comando
 
+# Evito la chiamata ridondante a cleanup
+trap - EXIT
+cleanup
+exit $COMMAND_STATUS
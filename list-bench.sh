@@ -0,0 +1,54 @@
+# Benchmark per list.c.
+# Crea un albero sintetico di <files> file (default 1000000) distribuiti in directory da 1000 file
+# ciascuna, raggruppate a 100 per volta, e lo visita con ogni backend di list.c (stat, statx,
+# uring e -n, che usa solo d_type). Per ogni esecuzione stampa tempo trascorso e numero di
+# system call riportato da list -s. L'albero viene creato una volta sola e riutilizzato.
+#
+# Esempio di utilizzo:
+# ./list-bench.sh /tmp/tree 1000000 4
+
+#!/bin/bash
+
+LIST=${LIST:-./list}
+
+if [ "$#" -lt 1 ]; then
+    echo "Usage: $0 <tree_dir> [files] [threads]"
+    exit 1
+fi
+
+TREE=$1
+FILES=${2:-1000000}
+THREADS=${3:-1}
+
+# Tempo trascorso in secondi (con millisecondi) dall'istante passato come argomento
+elapsed() {
+    local start="$1"
+    local now=$(date +%s.%N)
+    awk -v a="$start" -v b="$now" 'BEGIN { printf "%.3f", b - a }'
+}
+
+# Creo l'albero solo se non esiste già
+if [ ! -d "$TREE" ]; then
+    echo "Creating $FILES files in $TREE"
+    dirs=$(((FILES + 999) / 1000))
+    for ((d = 0; d < dirs; d++)); do
+        dir="$TREE/g$((d / 100))/d$d"
+        mkdir -p "$dir"
+        (cd "$dir" && seq -f "f%g" 1000 | xargs touch)
+    done
+fi
+
+# Svuoto la cache delle directory e degli inode, se ho i permessi, per misurare anche il caso freddo
+drop_caches() {
+    sync
+    echo 2 > /proc/sys/vm/drop_caches 2> /dev/null
+}
+
+for mode in "-b stat" "-b statx" "-b uring" "-n"; do
+    for cache in cold warm; do
+        [ "$cache" = cold ] && drop_caches
+        start=$(date +%s.%N)
+        stats=$($LIST -s -j "$THREADS" $mode "$TREE" 2>&1 > /dev/null | grep "^Syscalls:")
+        echo "$mode ($cache): $(elapsed "$start") s, $stats"
+    done
+done
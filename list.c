@@ -11,7 +11,39 @@
 *  Gruppo Proprietario: group ID e nome del gruppo, separati da spazio (si consideri la funzione getgrgid)
 */
 
+/*
+* Estensioni rispetto al testo dell'esercizio:
+*  -j N: visita l'albero con N thread. Ogni thread ha una coda (deque) di directory da visitare:
+*        estrae dal fondo della propria e, quando è vuota, ruba dalla cima di quella degli altri.
+*  Le directory vengono aperte con openat e le voci lette con fstatat rispetto al file descriptor
+*  della directory padre, così il kernel non risolve ogni volta il percorso completo, e i percorsi
+*  stampati non hanno limiti di lunghezza.
+*  Le voci sono lette con getdents64 in un buffer grande. -b sceglie come ottenere i metadati:
+*        stat  (fstatat per ogni voce), statx (default, chiede al kernel solo i campi stampati)
+*        o uring (una richiesta IORING_OP_STATX per voce, inviate a blocchi con io_uring).
+*  -n: stampa solo nome e tipo, presi da d_type senza chiamare stat quando il filesystem lo fornisce.
+*  -s: stampa su stderr il numero di system call usate per la visita.
+*  -o: formato di output. text (default) è quello dell'esercizio; ndjson stampa un oggetto JSON
+*        per riga; binary stampa per ogni voce un BinaryRecord a lunghezza fissa seguito dal
+*        percorso. I nomi di utenti e gruppi vengono risolti una volta per id e memorizzati, e
+*        ogni thread accumula l'output in un buffer scritto con una sola write quando è pieno.
+*  -i FILE: a fine visita salva un indice dei metadati in FILE; se FILE esiste già (visita
+*        precedente) viene mappato con mmap e le directory con inode, mtime e ctime invariati non
+*        vengono rilette: le loro voci si prendono dall'indice e si riesaminano solo le
+*        sottodirectory. Un file riscritto sul posto in una directory invariata non viene quindi
+*        rilevato. -d stampa solo le voci aggiunte, rimosse o modificate rispetto all'indice.
+*  -a: invece delle singole voci stampa per ogni directory i totali ricorsivi (byte, spazio
+*        allocato, file, directory e gli stessi totali per proprietario), come du. I totali
+*        risalgono dalle foglie alla radice man mano che le visite dei thread si concludono; i
+*        file con più hard link sono contati una volta sola. -t N stampa solo le N più grandi.
+*
+* Compilazione: gcc -O2 -pthread list.c -o list
+*/
+
+#define _GNU_SOURCE     // Per getpwuid_r, getgrgid_r e statx
+
 #include <stdio.h>      // Per funzioni di input/output come printf
+#include <stdlib.h>     // Per malloc, free, exit
 #include <sys/types.h>  // Definisce tipi come uid_t, gid_t, etc.
 #include <sys/stat.h>   // Definisce la struttura stat per ottenere informazioni sui file
 #include <unistd.h>     // Contiene funzioni come lstat per ottenere informazioni sui file
@@ -19,17 +51,293 @@
 #include <pwd.h>        // Per ottenere informazioni sugli utenti tramite getpwuid
 #include <grp.h>        // Per ottenere informazioni sui gruppi tramite getgrgid
 #include <string.h>     // Per funzioni string come strcmp e snprintf
+#include <fcntl.h>      // Per openat e le costanti O_*
+#include <pthread.h>    // Per i thread e i mutex
+#include <stdatomic.h>  // Per i contatori condivisi tra i thread
+#include <errno.h>      // Per errno
+#include <stdint.h>     // Per i tipi a dimensione fissa del formato binario
+#include <sys/syscall.h> // Per getdents64 e le system call di io_uring, senza wrapper in glibc
+#include <sys/mman.h>   // Per mappare gli anelli di io_uring e l'indice
+#include <limits.h>     // Per NAME_MAX
+#include <sys/sysmacros.h> // Per makedev
+#include <linux/io_uring.h>
+
+#define MAX_THREADS 256
+#define DENTS_SIZE (256 * 1024)  // Buffer per getdents64: centinaia di voci per system call
+#define RING_ENTRIES 256         // Richieste statx inviate insieme con io_uring
+#define OUT_SIZE (1024 * 1024)   // Buffer di output di ogni thread
+
+// Campi chiesti a statx: soltanto quelli stampati, più i tempi di modifica con -i
+#define STATX_MASK (STATX_INO | STATX_TYPE | STATX_SIZE | STATX_UID | STATX_GID)
+#define INDEX_MAGIC "LISTIDX1"
+
+enum { BACKEND_STAT, BACKEND_STATX, BACKEND_URING };
+int backend = BACKEND_STATX;
+int names_only = 0;   // -n: solo nome e tipo
+int show_stats = 0;   // -s: conteggio delle system call
+
+enum { FORMAT_TEXT, FORMAT_NDJSON, FORMAT_BINARY };
+int output_format = FORMAT_TEXT;  // -o: formato di output
+
+unsigned statx_mask = STATX_MASK;  // Campi chiesti a statx
+char *index_path = NULL;           // -i: file dell'indice
+int diff_mode = 0;                 // -d: stampa solo le differenze rispetto all'indice
+int aggregate = 0;                 // -a: totali ricorsivi per directory invece delle singole voci
+int top_n = 0;                     // -t: stampa solo le top_n directory più grandi
+
+// Contatori delle system call della visita, stampati con -s
+atomic_long count_getdents, count_openat, count_stat, count_uring_enter;
+atomic_long count_reused;  // Directory non modificate, le cui voci sono state prese dall'indice
+
+// Voce restituita da getdents64 (glibc non esporta la struttura)
+struct linux_dirent64 {
+    ino_t d_ino;
+    off_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/**
+ * Anello io_uring di un thread, mappato a mano senza liburing
+ */
+typedef struct {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+} Ring;
+
+/**
+ * Directory da visitare. Il file descriptor resta aperto finché i figli non l'hanno usato
+ * con openat: fd_users conta le sottodirectory ancora da aprire più la scansione in corso
+ */
+typedef struct Dir {
+    struct Dir *parent;   // Directory padre, NULL per la radice
+    char *path;           // Percorso completo, usato solo per la stampa
+    size_t path_len;
+    size_t name_off;      // Posizione del nome della directory dentro path
+    int fd;               // File descriptor, -1 finché la directory non è aperta
+    atomic_int fd_users;
+    int reuse;            // Con -i: directory non modificata, le voci si prendono dall'indice
+    struct Rollup *rollup;  // Con -a: totali della directory
+} Dir;
+
+/**
+ * Coda di directory di un thread: il proprietario inserisce ed estrae dal fondo (tail),
+ * gli altri thread rubano dalla cima (head)
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    Dir **items;
+    size_t head, tail, cap;  // Indici crescenti, usati modulo cap
+} Deque;
+
+Deque deques[MAX_THREADS];
+int num_threads = 1;
+atomic_long pending = 0;  // Directory inserite in una coda e non ancora visitate
+
+// I thread senza lavoro dormono su idle_cond: deque_push ne sveglia uno, l'ultima directory
+// visitata li sveglia tutti. work_epoch conta gli inserimenti, così un thread che ha trovato
+// le code vuote non si addormenta se nel frattempo è arrivata una directory
+pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+atomic_int idle_waiters = 0;
+atomic_ulong work_epoch = 0;
+
+/**
+ * Funzione per allocare memoria terminando il programma in caso di errore
+ * @param size: Numero di byte da allocare
+ * @return: Puntatore alla memoria allocata
+ */
+void *xmalloc(size_t size) {
+    void *ptr = malloc(size);
+    if (ptr == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    return ptr;
+}
+
+/**
+ * Cache di un thread che associa uid o gid al nome: un albero ha di solito pochi proprietari
+ * distinti, quindi getpwuid_r e getgrgid_r (che con NSS possono costare una richiesta a sssd
+ * o LDAP) vengono chiamate una volta per id invece che una volta per file
+ */
+typedef struct {
+    unsigned *ids;
+    char **names;
+    size_t count, cap;  // cap è una potenza di 2, le celle vuote hanno names[i] == NULL
+} NameCache;
+
+__thread NameCache user_cache, group_cache;
+
+/**
+ * Funzione per cercare il nome di un utente o di un gruppo, interrogando NSS solo la prima volta
+ * @param cache: Cache degli utenti o dei gruppi
+ * @param id: uid o gid
+ * @param is_group: 0 per gli utenti, 1 per i gruppi
+ * @return: Il nome, "unknown" se l'id non esiste
+ */
+const char *lookup_name(NameCache *cache, unsigned id, int is_group) {
+    if (cache->count * 2 >= cache->cap) {
+        // Tabella piena per metà: raddoppio e reinserisco le voci
+        size_t cap = cache->cap ? cache->cap * 2 : 16;
+        unsigned *ids = xmalloc(cap * sizeof(unsigned));
+        char **names = calloc(cap, sizeof(char *));
+        if (names == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        for (size_t i = 0; i < cache->cap; i++) {
+            if (cache->names[i] == NULL) continue;
+            size_t k = (cache->ids[i] * 2654435761u) & (cap - 1);
+            while (names[k] != NULL) k = (k + 1) & (cap - 1);
+            ids[k] = cache->ids[i];
+            names[k] = cache->names[i];
+        }
+        free(cache->ids);
+        free(cache->names);
+        cache->ids = ids;
+        cache->names = names;
+        cache->cap = cap;
+    }
+
+    size_t k = (id * 2654435761u) & (cache->cap - 1);  // Hash moltiplicativo, scansione lineare
+    while (cache->names[k] != NULL) {
+        if (cache->ids[k] == id) return cache->names[k];
+        k = (k + 1) & (cache->cap - 1);
+    }
+
+    // Prima volta che incontro questo id: uso le versioni rientranti, sicure con più thread
+    char buf[4096];
+    const char *name = "unknown";
+    if (is_group) {
+        struct group grp, *gr = NULL;
+        if (getgrgid_r(id, &grp, buf, sizeof(buf), &gr) == 0 && gr) name = gr->gr_name;
+    } else {
+        struct passwd pwd, *pw = NULL;
+        if (getpwuid_r(id, &pwd, buf, sizeof(buf), &pw) == 0 && pw) name = pw->pw_name;
+    }
+    cache->ids[k] = id;
+    cache->names[k] = strdup(name);
+    cache->count++;
+    return cache->names[k];
+}
+
+/**
+ * Buffer di output di un thread: le voci vengono formattate qui e scritte su stdout con una
+ * sola write quando il buffer è pieno, invece di sei printf per voce
+ */
+__thread char *out_buf;
+__thread size_t out_len;
+pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;  // Una write su una pipe oltre PIPE_BUF non è atomica
+
+/**
+ * Funzione per scrivere su stdout il buffer del thread
+ */
+void flush_output(void) {
+    pthread_mutex_lock(&out_lock);
+    size_t done = 0;
+    while (done < out_len) {
+        ssize_t n = write(STDOUT_FILENO, out_buf + done, out_len - done);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("write");
+            exit(1);
+        }
+        done += n;
+    }
+    pthread_mutex_unlock(&out_lock);
+    out_len = 0;
+}
+
+/**
+ * Funzione per garantire spazio nel buffer di output per almeno n byte
+ * @param n: Byte da aggiungere
+ */
+void out_reserve(size_t n) {
+    if (out_buf == NULL) out_buf = xmalloc(OUT_SIZE);
+    if (out_len + n > OUT_SIZE) flush_output();
+    if (n > OUT_SIZE) {
+        // Voce più grande dell'intero buffer (percorso lunghissimo): la alloco a parte
+        out_buf = realloc(out_buf, n);
+        if (out_buf == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+}
+
+/**
+ * Funzioni per accodare al buffer di output byte, stringhe e numeri senza passare da printf.
+ * Lo spazio deve essere già stato riservato con out_reserve
+ */
+void out_bytes(const void *src, size_t n) {
+    memcpy(out_buf + out_len, src, n);
+    out_len += n;
+}
+
+void out_str(const char *str) {
+    out_bytes(str, strlen(str));
+}
+
+void out_num(unsigned long long value) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (n > 0) out_buf[out_len++] = digits[--n];
+}
 
 /**
- * Funzione per stampare i dettagli di un file/directory dato il suo percorso e la struttura stat
+ * Funzione per accodare una stringa JSON, con i caratteri speciali in escape
+ * @param str: Stringa da accodare
+ * @param len: Lunghezza della stringa
+ */
+void out_json_str(const char *str, size_t len) {
+    out_buf[out_len++] = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = str[i];
+        if (c == '"' || c == '\\') {
+            out_buf[out_len++] = '\\';
+            out_buf[out_len++] = c;
+        } else if (c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            out_bytes("\\u00", 4);
+            out_buf[out_len++] = hex[c >> 4];
+            out_buf[out_len++] = hex[c & 15];
+        } else {
+            out_buf[out_len++] = c;
+        }
+    }
+    out_buf[out_len++] = '"';
+}
+
+/**
+ * Record del formato binario (-o binary): intestazione a lunghezza fissa seguita da path_len
+ * byte di percorso, senza terminatore. Tutti i campi sono nell'ordine dei byte della macchina
+ */
+typedef struct {
+    uint64_t ino;
+    uint64_t size;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t mode;
+    uint32_t path_len;
+} BinaryRecord;
+
+/**
+ * Funzione per stampare i dettagli di un file/directory dato il suo percorso e la struttura stat,
+ * nel formato scelto con -o. Con -n sono validi solo il percorso e il tipo
  * @param path: Percorso del file o della directory
  * @param statbuf: Puntatore alla struttura stat contenente le informazioni del file
  */
 void print_info(const char *path, struct stat *statbuf) {
-    // Ottengo le informazioni dell'utente proprietario usando l'ID utente
-    struct passwd *pw = getpwuid(statbuf->st_uid);
-    // Ottengo le informazioni del gruppo proprietario usando l'ID gruppo
-    struct group *gr = getgrgid(statbuf->st_gid);
+    size_t path_len = strlen(path);
 
     // Determino il tipo di file (file, directory, symbolic link, FIFO, altro)
     const char *type;
@@ -39,56 +347,1150 @@ void print_info(const char *path, struct stat *statbuf) {
     else if (S_ISFIFO(statbuf->st_mode)) type = "FIFO";
     else type = "other";
 
-    // Stampo i dettagli secondo il formato richiesto
-    printf("Node: %s\n", path);
-    printf("    Inode: %ld\n", (long)statbuf->st_ino);
-    printf("    Type: %s\n", type);
-    printf("    Size: %ld\n", (long)statbuf->st_size);
-    printf("    Owner: %d %s\n", statbuf->st_uid, pw ? pw->pw_name : "unknown");
-    printf("    Group: %d %s\n", statbuf->st_gid, gr ? gr->gr_name : "unknown");
+    if (output_format == FORMAT_BINARY) {
+        BinaryRecord rec = {
+            .ino = statbuf->st_ino, .size = statbuf->st_size, .uid = statbuf->st_uid,
+            .gid = statbuf->st_gid, .mode = statbuf->st_mode, .path_len = path_len
+        };
+        out_reserve(sizeof(rec) + path_len);
+        out_bytes(&rec, sizeof(rec));
+        out_bytes(path, path_len);
+        return;
+    }
+
+    // Ottengo i nomi dell'utente e del gruppo proprietario dalla cache del thread
+    const char *user = "", *group = "";
+    if (!names_only) {
+        user = lookup_name(&user_cache, statbuf->st_uid, 0);
+        group = lookup_name(&group_cache, statbuf->st_gid, 1);
+    }
+    // Spazio sufficiente nel caso peggiore: ogni byte del percorso in escape occupa 6 byte
+    out_reserve(6 * path_len + strlen(user) + strlen(group) + 256);
+
+    if (output_format == FORMAT_NDJSON) {
+        out_str("{\"path\":");
+        out_json_str(path, path_len);
+        out_str(",\"type\":\"");
+        out_str(type);
+        out_str("\"");
+        if (!names_only) {
+            out_str(",\"ino\":"); out_num(statbuf->st_ino);
+            out_str(",\"size\":"); out_num(statbuf->st_size);
+            out_str(",\"uid\":"); out_num(statbuf->st_uid);
+            out_str(",\"user\":"); out_json_str(user, strlen(user));
+            out_str(",\"gid\":"); out_num(statbuf->st_gid);
+            out_str(",\"group\":"); out_json_str(group, strlen(group));
+        }
+        out_str("}\n");
+        return;
+    }
+
+    // Formato testuale richiesto dall'esercizio
+    out_str("Node: "); out_bytes(path, path_len); out_str("\n");
+    if (!names_only) { out_str("    Inode: "); out_num(statbuf->st_ino); out_str("\n"); }
+    out_str("    Type: "); out_str(type); out_str("\n");
+    if (!names_only) {
+        out_str("    Size: "); out_num(statbuf->st_size); out_str("\n");
+        out_str("    Owner: "); out_num(statbuf->st_uid); out_str(" "); out_str(user); out_str("\n");
+        out_str("    Group: "); out_num(statbuf->st_gid); out_str(" "); out_str(group); out_str("\n");
+    }
 }
 
 /**
- * Funzione per attraversare ricorsivamente una directory e stampare i dettagli dei file contenuti
- * @param dirpath: Percorso della directory da attraversare
+ * Funzione per inserire una directory in fondo alla coda di un thread
+ * @param dq: Coda in cui inserire
+ * @param dir: Directory da visitare
  */
-void traverse_directory(const char *dirpath) {
-    struct dirent *entry;         // Puntatore a struct dirent per leggere le directory
-    struct stat statbuf;          // Buffer per contenere le informazioni del file
-    DIR *dir = opendir(dirpath);  // Apro la directory specificata
-    if (!dir) {
-        // Gestisco gli errori nell'apertura della directory
-        perror("opendir");
+void deque_push(Deque *dq, Dir *dir) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail - dq->head == dq->cap) {
+        // Coda piena: raddoppio la capacità ricopiando gli elementi nell'ordine
+        size_t cap = dq->cap ? dq->cap * 2 : 64;
+        Dir **items = xmalloc(cap * sizeof(Dir *));
+        for (size_t i = dq->head; i < dq->tail; i++) items[i - dq->head] = dq->items[i % dq->cap];
+        free(dq->items);
+        dq->items = items;
+        dq->tail -= dq->head;
+        dq->head = 0;
+        dq->cap = cap;
+    }
+    dq->items[dq->tail++ % dq->cap] = dir;
+    pthread_mutex_unlock(&dq->lock);
+
+    atomic_fetch_add(&work_epoch, 1);
+    if (atomic_load(&idle_waiters) > 0) {
+        pthread_mutex_lock(&idle_lock);
+        pthread_cond_signal(&idle_cond);
+        pthread_mutex_unlock(&idle_lock);
+    }
+}
+
+/**
+ * Funzione per estrarre una directory dalla coda di un thread
+ * @param dq: Coda da cui estrarre
+ * @param steal: 0 per estrarre dal fondo (proprietario), 1 per rubare dalla cima
+ * @return: La directory estratta, NULL se la coda è vuota
+ */
+Dir *deque_pop(Deque *dq, int steal) {
+    Dir *dir = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head != dq->tail) {
+        dir = steal ? dq->items[dq->head++ % dq->cap] : dq->items[--dq->tail % dq->cap];
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return dir;
+}
+
+/**
+ * Funzione per segnalare che un utente del file descriptor di una directory ha finito:
+ * l'ultimo chiude il file descriptor e libera la directory
+ * @param dir: Directory da rilasciare
+ */
+void release_dir(Dir *dir) {
+    if (atomic_fetch_sub(&dir->fd_users, 1) == 1) {
+        if (dir->fd != -1) close(dir->fd);
+        free(dir->path);
+        free(dir);
+    }
+}
+
+/**
+ * Funzione per convertire il risultato di statx nella struttura stat usata da print_info
+ * @param stx: Risultato di statx
+ * @param statbuf: Struttura da riempire con i campi chiesti in statx_mask
+ */
+void statx_to_stat(const struct statx *stx, struct stat *statbuf) {
+    memset(statbuf, 0, sizeof(*statbuf));
+    statbuf->st_ino = stx->stx_ino;
+    statbuf->st_mode = stx->stx_mode;
+    statbuf->st_size = stx->stx_size;
+    statbuf->st_uid = stx->stx_uid;
+    statbuf->st_gid = stx->stx_gid;
+    statbuf->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    statbuf->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+    statbuf->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+    statbuf->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+    statbuf->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    statbuf->st_nlink = stx->stx_nlink;
+    statbuf->st_blocks = stx->stx_blocks;
+}
+
+/**
+ * Funzione per convertire d_type nel tipo di st_mode
+ * @param d_type: Tipo restituito da getdents64
+ * @return: Il tipo nel formato di st_mode, 0 se il filesystem non lo fornisce
+ */
+mode_t dtype_to_mode(unsigned char d_type) {
+    switch (d_type) {
+        case DT_REG: return S_IFREG;
+        case DT_DIR: return S_IFDIR;
+        case DT_LNK: return S_IFLNK;
+        case DT_FIFO: return S_IFIFO;
+        case DT_CHR: return S_IFCHR;
+        case DT_BLK: return S_IFBLK;
+        case DT_SOCK: return S_IFSOCK;
+        default: return 0;
+    }
+}
+
+/**
+ * Funzione per creare l'anello io_uring del thread
+ * @param ring: Anello da inizializzare
+ * @return: 0 in caso di successo, -1 se io_uring non è disponibile
+ */
+int ring_init(Ring *ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (ring->fd == -1) return -1;
+
+    // Mappo la coda delle richieste (SQ), quella dei completamenti (CQ) e l'array delle SQE
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size) sq_size = cq_size;
+        cq_size = sq_size;
+    }
+    char *sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    char *cq = sq;
+    if (sq != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+/**
+ * Funzione per ottenere con io_uring i metadati di un blocco di voci della stessa directory:
+ * invio tutte le richieste statx con una sola io_uring_enter e ne attendo i completamenti
+ * @param ring: Anello del thread
+ * @param dir_fd: Directory delle voci
+ * @param names: Nomi delle voci, al più RING_ENTRIES
+ * @param count: Numero di voci
+ * @param stx: Risultati, nello stesso ordine dei nomi
+ * @param res: Esito di ogni richiesta (0 o -errno)
+ */
+void ring_statx(Ring *ring, int dir_fd, char **names, int count, struct statx *stx, int *res) {
+    unsigned tail = *ring->sq_tail;  // Solo questo thread scrive la coda delle richieste
+    for (int i = 0; i < count; i++) {
+        unsigned idx = tail & *ring->sq_mask;
+        struct io_uring_sqe *sqe = &ring->sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = dir_fd;
+        sqe->addr = (unsigned long)names[i];
+        sqe->len = statx_mask;
+        sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+        sqe->off = (unsigned long)&stx[i];
+        sqe->user_data = i;
+        ring->sq_array[idx] = idx;
+        tail++;
+    }
+    atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, tail, memory_order_release);
+
+    int done = 0;
+    while (done < count) {
+        // Invio le richieste e attendo che siano tutte completate
+        atomic_fetch_add(&count_uring_enter, 1);
+        int ret = syscall(__NR_io_uring_enter, ring->fd, done == 0 ? count : 0, count - done,
+                          IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret == -1 && errno != EINTR) {
+            perror("io_uring_enter");
+            exit(1);
+        }
+        unsigned head = *ring->cq_head;
+        while (head != atomic_load_explicit((_Atomic unsigned *)ring->cq_tail, memory_order_acquire)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            res[cqe->user_data] = cqe->res;
+            head++;
+            done++;
+        }
+        atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head, memory_order_release);
+    }
+}
+
+// Buffer di ogni thread, allocati alla prima visita
+__thread char *dents;             // Buffer per getdents64
+__thread char **names;            // Nomi delle voci dell'ultimo buffer letto
+__thread unsigned char *types;    // d_type delle stesse voci
+__thread char *fullpath;          // Percorso completo della voce, riallocato se serve
+__thread size_t fullpath_cap;
+__thread Ring ring;               // Anello io_uring, con -b uring
+__thread struct statx *ring_stx;  // Risultati delle richieste statx inviate con io_uring
+__thread int *ring_res;
+
+/**
+ * Indice su disco (-i). Il file contiene un IndexHeader, count IndexRecord ordinati per
+ * (directory padre, nome) e i percorsi, uno dopo l'altro e senza terminatore. Con questo
+ * ordinamento le voci di una stessa directory sono contigue, quindi si trovano con una ricerca
+ * binaria. Il file viene mappato in memoria con mmap e mai copiato
+ */
+typedef struct {
+    char magic[8];
+    uint64_t count;
+} IndexHeader;
+
+typedef struct {
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t ctime_sec;
+    uint32_t mtime_nsec;
+    uint32_t ctime_nsec;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t mode;
+    uint32_t path_len;
+    uint64_t path_off;  // Posizione del percorso nel file
+} IndexRecord;
+
+// Indice della visita precedente, mappato in sola lettura
+const char *old_map = NULL;
+size_t old_map_size = 0;
+const IndexRecord *old_records = NULL;
+uint64_t old_count = 0;
+
+// Voce raccolta durante la visita, da scrivere nel nuovo indice
+typedef struct {
+    IndexRecord rec;
+    const char *path;
+} Entry;
+
+// Voci raccolte da un thread; le liste di tutti i thread sono collegate in all_entries
+typedef struct EntryList {
+    Entry *items;
+    size_t count, cap;
+    struct EntryList *next;
+} EntryList;
+
+EntryList *all_entries = NULL;
+pthread_mutex_t entries_lock = PTHREAD_MUTEX_INITIALIZER;
+__thread EntryList *entries;
+__thread char *arena;        // Blocco da cui copio i percorsi delle voci, liberato a fine programma
+__thread size_t arena_left;
+
+/**
+ * Funzione per confrontare due percorsi nell'ordine dell'indice: prima la directory padre,
+ * poi il nome
+ * @return: Negativo, zero o positivo come strcmp
+ */
+int compare_paths(const char *a, size_t alen, const char *b, size_t blen) {
+    const char *sa = memrchr(a, '/', alen), *sb = memrchr(b, '/', blen);
+    size_t pa = sa ? (size_t)(sa - a) : 0, pb = sb ? (size_t)(sb - b) : 0;  // Lunghezza del padre
+    int cmp = memcmp(a, b, pa < pb ? pa : pb);
+    if (cmp != 0 || pa != pb) return cmp != 0 ? cmp : (pa < pb ? -1 : 1);
+    // Stesso padre: confronto i nomi
+    size_t na = alen - pa, nb = blen - pb;
+    cmp = memcmp(a + pa, b + pb, na < nb ? na : nb);
+    return cmp != 0 ? cmp : (na > nb) - (na < nb);
+}
+
+const char *old_path(const IndexRecord *rec) {
+    return old_map + rec->path_off;
+}
+
+/**
+ * Funzione per cercare nell'indice precedente il primo record non minore di un percorso
+ * @param path: Percorso cercato
+ * @param len: Lunghezza del percorso
+ * @return: Posizione del record, old_count se non esiste
+ */
+uint64_t index_lower_bound(const char *path, size_t len) {
+    uint64_t lo = 0, hi = old_count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (compare_paths(old_path(&old_records[mid]), old_records[mid].path_len, path, len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Funzione per cercare un percorso nell'indice precedente
+ * @return: Il record, NULL se non esiste
+ */
+const IndexRecord *index_find(const char *path, size_t len) {
+    uint64_t i = index_lower_bound(path, len);
+    if (i < old_count && old_records[i].path_len == len && memcmp(old_path(&old_records[i]), path, len) == 0)
+        return &old_records[i];
+    return NULL;
+}
+
+/**
+ * Funzione per mappare l'indice della visita precedente, se esiste
+ */
+void index_load(void) {
+    int fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != ENOENT) perror("open index");
+        return;  // Nessun indice: la visita è completa
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        fprintf(stderr, "Invalid index %s, ignoring it\n", index_path);
+        close(fd);
+        return;
+    }
+    old_map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (old_map == MAP_FAILED) {
+        perror("mmap index");
+        old_map = NULL;
         return;
     }
+    // La tabella dei record deve stare nel file e ogni percorso deve stare dopo la tabella:
+    // un indice troncato o corrotto viene ignorato e la visita è completa
+    const IndexHeader *hdr = (const IndexHeader *)old_map;
+    size_t size = st.st_size;
+    int valid = memcmp(hdr->magic, INDEX_MAGIC, 8) == 0 &&
+                hdr->count <= (size - sizeof(IndexHeader)) / sizeof(IndexRecord);
+    if (valid) {
+        const IndexRecord *records = (const IndexRecord *)(old_map + sizeof(IndexHeader));
+        uint64_t paths_start = sizeof(IndexHeader) + hdr->count * sizeof(IndexRecord);
+        for (uint64_t i = 0; i < hdr->count && valid; i++) {
+            valid = records[i].path_off >= paths_start && records[i].path_off <= size &&
+                    records[i].path_len <= size - records[i].path_off;
+        }
+    }
+    if (!valid) {
+        fprintf(stderr, "Invalid index %s, ignoring it\n", index_path);
+        munmap((void *)old_map, st.st_size);
+        old_map = NULL;
+        return;
+    }
+    old_map_size = st.st_size;
+    old_records = (const IndexRecord *)(old_map + sizeof(IndexHeader));
+    old_count = hdr->count;
+}
 
-    // Ciclo attraverso tutte le voci della directory
-    while ((entry = readdir(dir)) != NULL) {
-        // Ignoro le directory speciali "." e ".."
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
+/**
+ * Funzione per convertire un record dell'indice nella struttura stat usata da print_info
+ */
+void record_to_stat(const IndexRecord *rec, struct stat *statbuf) {
+    memset(statbuf, 0, sizeof(*statbuf));
+    statbuf->st_ino = rec->ino;
+    statbuf->st_size = rec->size;
+    statbuf->st_uid = rec->uid;
+    statbuf->st_gid = rec->gid;
+    statbuf->st_mode = rec->mode;
+    statbuf->st_mtim.tv_sec = rec->mtime_sec;
+    statbuf->st_mtim.tv_nsec = rec->mtime_nsec;
+    statbuf->st_ctim.tv_sec = rec->ctime_sec;
+    statbuf->st_ctim.tv_nsec = rec->ctime_nsec;
+}
+
+/**
+ * Funzione per sapere se una directory è invariata rispetto all'indice: stesso inode e stessi
+ * mtime e ctime. Aggiungere, rimuovere o rinominare una voce aggiorna mtime della directory;
+ * la modifica del contenuto di un file invece non la tocca, quindi in una directory invariata
+ * un file riscritto sul posto (senza essere sostituito) non viene rilevato
+ */
+int dir_unchanged(const char *path, size_t len, const struct stat *statbuf) {
+    if (old_map == NULL) return 0;
+    const IndexRecord *rec = index_find(path, len);
+    return rec != NULL && S_ISDIR(rec->mode) && rec->ino == statbuf->st_ino &&
+           rec->mtime_sec == statbuf->st_mtim.tv_sec && rec->mtime_nsec == statbuf->st_mtim.tv_nsec &&
+           rec->ctime_sec == statbuf->st_ctim.tv_sec && rec->ctime_nsec == statbuf->st_ctim.tv_nsec;
+}
+
+/**
+ * Funzione per aggiungere una voce al nuovo indice, nella lista del thread
+ * @param path: Percorso della voce
+ * @param len: Lunghezza del percorso
+ * @param statbuf: Metadati della voce
+ */
+void index_add(const char *path, size_t len, const struct stat *statbuf) {
+    if (entries == NULL) {
+        entries = calloc(1, sizeof(EntryList));
+        if (entries == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        pthread_mutex_lock(&entries_lock);
+        entries->next = all_entries;
+        all_entries = entries;
+        pthread_mutex_unlock(&entries_lock);
+    }
+    if (entries->count == entries->cap) {
+        entries->cap = entries->cap ? entries->cap * 2 : 1024;
+        entries->items = realloc(entries->items, entries->cap * sizeof(Entry));
+        if (entries->items == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    if (arena_left < len) {
+        arena_left = len > OUT_SIZE ? len : OUT_SIZE;
+        arena = xmalloc(arena_left);
+    }
+    memcpy(arena, path, len);
+
+    Entry *e = &entries->items[entries->count++];
+    e->path = arena;
+    e->rec = (IndexRecord){
+        .ino = statbuf->st_ino, .size = statbuf->st_size,
+        .mtime_sec = statbuf->st_mtim.tv_sec, .mtime_nsec = statbuf->st_mtim.tv_nsec,
+        .ctime_sec = statbuf->st_ctim.tv_sec, .ctime_nsec = statbuf->st_ctim.tv_nsec,
+        .uid = statbuf->st_uid, .gid = statbuf->st_gid, .mode = statbuf->st_mode, .path_len = len
+    };
+    arena += len;
+    arena_left -= len;
+}
+
+int compare_entries(const void *a, const void *b) {
+    const Entry *ea = a, *eb = b;
+    return compare_paths(ea->path, ea->rec.path_len, eb->path, eb->rec.path_len);
+}
+
+/**
+ * Funzione per stampare una differenza rispetto all'indice precedente nel formato scelto
+ * @param change: "added", "removed" o "modified"
+ * @param path: Percorso della voce
+ * @param len: Lunghezza del percorso
+ */
+void print_change(const char *change, const char *path, size_t len) {
+    out_reserve(6 * len + 64);
+    if (output_format == FORMAT_NDJSON) {
+        out_str("{\"change\":\""); out_str(change); out_str("\",\"path\":");
+        out_json_str(path, len);
+        out_str("}\n");
+    } else {
+        // Formato testuale, anche con -o binary: le differenze sono poche e pensate per essere lette
+        out_buf[out_len++] = change[0] - 'a' + 'A';
+        out_str(change + 1); out_str(": "); out_bytes(path, len); out_str("\n");
+    }
+}
+
+/**
+ * Funzione per ordinare le voci raccolte, stampare con -d le differenze rispetto all'indice
+ * precedente e scrivere il nuovo indice. Il nuovo indice viene scritto in un file temporaneo
+ * e rinominato, così una visita interrotta non lascia un indice a metà
+ */
+void index_finish(void) {
+    size_t total = 0;
+    for (EntryList *l = all_entries; l != NULL; l = l->next) total += l->count;
+    Entry *all = xmalloc((total ? total : 1) * sizeof(Entry));
+    size_t n = 0;
+    for (EntryList *l = all_entries; l != NULL; l = l->next) {
+        memcpy(all + n, l->items, l->count * sizeof(Entry));
+        n += l->count;
+    }
+    qsort(all, total, sizeof(Entry), compare_entries);
+
+    if (diff_mode) {
+        // Fondo le due liste ordinate
+        uint64_t i = 0;
+        size_t j = 0;
+        while (i < old_count || j < total) {
+            int cmp = i == old_count ? 1 : j == total ? -1 :
+                      compare_paths(old_path(&old_records[i]), old_records[i].path_len, all[j].path, all[j].rec.path_len);
+            if (cmp < 0) {
+                print_change("removed", old_path(&old_records[i]), old_records[i].path_len);
+                i++;
+            } else if (cmp > 0) {
+                print_change("added", all[j].path, all[j].rec.path_len);
+                j++;
+            } else {
+                const IndexRecord *o = &old_records[i], *r = &all[j].rec;
+                if (o->ino != r->ino || o->size != r->size || o->mode != r->mode || o->uid != r->uid ||
+                    o->gid != r->gid || o->mtime_sec != r->mtime_sec || o->mtime_nsec != r->mtime_nsec)
+                    print_change("modified", all[j].path, r->path_len);
+                i++;
+                j++;
+            }
+        }
+        flush_output();
+    }
+
+    size_t tmp_len = strlen(index_path) + 8;
+    char *tmp_path = xmalloc(tmp_len);
+    snprintf(tmp_path, tmp_len, "%s.tmp", index_path);
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        perror("fopen index");
+        exit(1);
+    }
+    setvbuf(file, NULL, _IOFBF, OUT_SIZE);
+
+    IndexHeader hdr = { .count = total };
+    memcpy(hdr.magic, INDEX_MAGIC, 8);
+    fwrite(&hdr, sizeof(hdr), 1, file);
+    uint64_t off = sizeof(hdr) + total * sizeof(IndexRecord);
+    for (size_t k = 0; k < total; k++) {
+        all[k].rec.path_off = off;
+        off += all[k].rec.path_len;
+        fwrite(&all[k].rec, sizeof(IndexRecord), 1, file);
+    }
+    for (size_t k = 0; k < total; k++) fwrite(all[k].path, 1, all[k].rec.path_len, file);
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0 || fclose(file) != 0 || rename(tmp_path, index_path) != 0) {
+        perror("write index");
+        exit(1);
+    }
+    free(tmp_path);
+    free(all);
+}
+
+/**
+ * Aggregazione (-a). Ogni directory ha un Rollup con i totali del suo sottoalbero. Il thread che
+ * visita una directory accumula le voci in local_totals e le somma al Rollup solo alla fine;
+ * unfinished conta la visita stessa più le sottodirectory non ancora concluse. Quando arriva a
+ * zero i totali sono completi: la directory viene riportata e sommata al padre, risalendo
+ * l'albero dal basso senza che nessun thread debba aspettare gli altri
+ */
+typedef struct {
+    unsigned uid;
+    uint64_t bytes, blocks, files;
+} OwnerTotal;
+
+typedef struct {
+    uint64_t bytes;   // Somma di st_size
+    uint64_t blocks;  // Blocchi da 512 byte allocati
+    uint64_t files;   // Voci che non sono directory
+    uint64_t dirs;    // Directory, compresa questa
+    OwnerTotal *owners;
+    int n_owners, cap_owners;
+} Totals;
+
+typedef struct Rollup {
+    struct Rollup *parent;
+    char *path;
+    pthread_mutex_t lock;   // Protegge totals mentre le sottodirectory vi si sommano
+    atomic_int unfinished;
+    Totals totals;
+} Rollup;
+
+__thread Totals local_totals;  // Voci della directory in visita nel thread corrente
+Rollup *root_rollup = NULL;    // Totali della radice, stampati alla fine
+
+// Heap (minimo in cima) delle directory più grandi viste dal thread, con -t
+typedef struct TopHeap {
+    Rollup **items;
+    int count;
+    struct TopHeap *next;
+} TopHeap;
+
+__thread TopHeap *top_heap;
+TopHeap *all_heaps = NULL;
+pthread_mutex_t heaps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Insieme (dev, inode) dei file con più hard link già contati, diviso in parti con un mutex
+ * ciascuna perché i thread lo aggiornino in parallelo. Ogni parte è una tabella ad
+ * indirizzamento aperto; dev è salvato più uno, così zero indica una cella vuota
+ */
+#define LINK_SHARDS 64
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t (*keys)[2];
+    size_t count, cap;
+} LinkShard;
+
+LinkShard link_shards[LINK_SHARDS];
+
+uint64_t link_hash(uint64_t dev, uint64_t ino) {
+    uint64_t h = (ino ^ (dev << 32 | dev >> 32)) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+/**
+ * Funzione per registrare un file con più hard link
+ * @return: 1 se è la prima volta che lo incontro, 0 se è già stato contato
+ */
+int link_first_seen(dev_t dev, ino_t ino) {
+    uint64_t h = link_hash(dev, ino);
+    LinkShard *shard = &link_shards[h % LINK_SHARDS];
+    h /= LINK_SHARDS;
+    pthread_mutex_lock(&shard->lock);
+    if (shard->count * 2 >= shard->cap) {
+        // Tabella piena per metà: raddoppio e reinserisco le chiavi
+        size_t cap = shard->cap ? shard->cap * 2 : 64;
+        uint64_t (*keys)[2] = calloc(cap, sizeof(*keys));
+        if (keys == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        for (size_t i = 0; i < shard->cap; i++) {
+            if (shard->keys[i][0] == 0) continue;
+            size_t j = link_hash(shard->keys[i][0] - 1, shard->keys[i][1]) / LINK_SHARDS & (cap - 1);
+            while (keys[j][0] != 0) j = (j + 1) & (cap - 1);
+            keys[j][0] = shard->keys[i][0];
+            keys[j][1] = shard->keys[i][1];
+        }
+        free(shard->keys);
+        shard->keys = keys;
+        shard->cap = cap;
+    }
+    size_t j = h & (shard->cap - 1);
+    int first = 1;
+    while (shard->keys[j][0] != 0) {
+        if (shard->keys[j][0] == (uint64_t)dev + 1 && shard->keys[j][1] == ino) {
+            first = 0;
+            break;
+        }
+        j = (j + 1) & (shard->cap - 1);
+    }
+    if (first) {
+        shard->keys[j][0] = (uint64_t)dev + 1;
+        shard->keys[j][1] = ino;
+        shard->count++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return first;
+}
+
+/**
+ * Funzione per aggiungere ai totali il contributo di un proprietario
+ */
+void totals_add_owner(Totals *t, unsigned uid, uint64_t bytes, uint64_t blocks, uint64_t files) {
+    int i = 0;
+    while (i < t->n_owners && t->owners[i].uid != uid) i++;  // I proprietari sono pochi
+    if (i == t->n_owners) {
+        if (t->n_owners == t->cap_owners) {
+            t->cap_owners = t->cap_owners ? t->cap_owners * 2 : 4;
+            t->owners = realloc(t->owners, t->cap_owners * sizeof(OwnerTotal));
+            if (t->owners == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        t->owners[t->n_owners++] = (OwnerTotal){ .uid = uid };
+    }
+    t->owners[i].bytes += bytes;
+    t->owners[i].blocks += blocks;
+    t->owners[i].files += files;
+}
+
+/**
+ * Funzione per aggiungere ai totali una voce. I file con più hard link vengono contati una sola volta
+ */
+void totals_add(Totals *t, const struct stat *statbuf) {
+    int is_dir = S_ISDIR(statbuf->st_mode);
+    if (!is_dir && statbuf->st_nlink > 1 && !link_first_seen(statbuf->st_dev, statbuf->st_ino)) return;
+    t->bytes += statbuf->st_size;
+    t->blocks += statbuf->st_blocks;
+    if (is_dir) t->dirs++;
+    else t->files++;
+    totals_add_owner(t, statbuf->st_uid, statbuf->st_size, statbuf->st_blocks, !is_dir);
+}
+
+/**
+ * Funzione per sommare i totali src a dst
+ */
+void totals_merge(Totals *dst, const Totals *src) {
+    dst->bytes += src->bytes;
+    dst->blocks += src->blocks;
+    dst->files += src->files;
+    dst->dirs += src->dirs;
+    for (int i = 0; i < src->n_owners; i++) {
+        const OwnerTotal *o = &src->owners[i];
+        totals_add_owner(dst, o->uid, o->bytes, o->blocks, o->files);
+    }
+}
+
+/**
+ * Funzione per creare il Rollup di una directory, inizializzato con la directory stessa
+ * @param parent: Rollup della directory padre, NULL per la radice
+ * @param path: Percorso della directory
+ * @param len: Lunghezza del percorso
+ * @param statbuf: Metadati della directory
+ */
+Rollup *rollup_new(Rollup *parent, const char *path, size_t len, const struct stat *statbuf) {
+    Rollup *r = xmalloc(sizeof(Rollup));
+    memset(r, 0, sizeof(*r));
+    r->parent = parent;
+    r->path = xmalloc(len + 1);
+    memcpy(r->path, path, len);
+    r->path[len] = '\0';
+    pthread_mutex_init(&r->lock, NULL);
+    atomic_init(&r->unfinished, 1);  // La visita della directory stessa
+    totals_add(&r->totals, statbuf);
+    if (parent != NULL) atomic_fetch_add(&parent->unfinished, 1);
+    return r;
+}
+
+void rollup_free(Rollup *r) {
+    pthread_mutex_destroy(&r->lock);
+    free(r->totals.owners);
+    free(r->path);
+    free(r);
+}
+
+/**
+ * Funzione per stampare i totali di una directory nel formato scelto
+ */
+void print_rollup(const Rollup *r) {
+    const Totals *t = &r->totals;
+    size_t path_len = strlen(r->path);
+    out_reserve(6 * path_len + 256);
+    if (output_format == FORMAT_NDJSON) {
+        out_str("{\"path\":"); out_json_str(r->path, path_len);
+        out_str(",\"size\":"); out_num(t->bytes);
+        out_str(",\"disk\":"); out_num(t->blocks * 512);
+        out_str(",\"files\":"); out_num(t->files);
+        out_str(",\"dirs\":"); out_num(t->dirs);
+        out_str(",\"owners\":[");
+    } else {
+        out_str("Directory: "); out_bytes(r->path, path_len); out_str("\n");
+        out_str("    Size: "); out_num(t->bytes); out_str("\n");
+        out_str("    Disk: "); out_num(t->blocks * 512); out_str("\n");
+        out_str("    Files: "); out_num(t->files); out_str("\n");
+        out_str("    Directories: "); out_num(t->dirs); out_str("\n");
+    }
+    for (int i = 0; i < t->n_owners; i++) {
+        const OwnerTotal *o = &t->owners[i];
+        const char *user = lookup_name(&user_cache, o->uid, 0);
+        out_reserve(6 * strlen(user) + 128);
+        if (output_format == FORMAT_NDJSON) {
+            if (i > 0) out_str(",");
+            out_str("{\"uid\":"); out_num(o->uid);
+            out_str(",\"user\":"); out_json_str(user, strlen(user));
+            out_str(",\"size\":"); out_num(o->bytes);
+            out_str(",\"disk\":"); out_num(o->blocks * 512);
+            out_str(",\"files\":"); out_num(o->files);
+            out_str("}");
+        } else {
+            out_str("    Owner: "); out_num(o->uid); out_str(" "); out_str(user);
+            out_str(" size "); out_num(o->bytes); out_str(", files "); out_num(o->files); out_str("\n");
+        }
+    }
+    if (output_format == FORMAT_NDJSON) out_str("]}\n");
+}
+
+void heap_swap(Rollup **items, int a, int b) {
+    Rollup *tmp = items[a];
+    items[a] = items[b];
+    items[b] = tmp;
+}
+
+/**
+ * Funzione per proporre una directory completata all'heap del thread: la tengo se è fra le
+ * top_n più grandi viste finora, altrimenti (o se ne scarto un'altra) libero il Rollup
+ */
+void top_offer(Rollup *r) {
+    if (top_heap == NULL) {
+        top_heap = calloc(1, sizeof(TopHeap));
+        if (top_heap == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        top_heap->items = xmalloc(top_n * sizeof(Rollup *));
+        pthread_mutex_lock(&heaps_lock);
+        top_heap->next = all_heaps;
+        all_heaps = top_heap;
+        pthread_mutex_unlock(&heaps_lock);
+    }
+    Rollup **items = top_heap->items;
+    if (top_heap->count < top_n) {
+        // Inserisco in fondo e risalgo
+        int i = top_heap->count++;
+        items[i] = r;
+        while (i > 0 && items[(i - 1) / 2]->totals.bytes > items[i]->totals.bytes) {
+            heap_swap(items, i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+        return;
+    }
+    if (r->totals.bytes <= items[0]->totals.bytes) {
+        rollup_free(r);
+        return;
+    }
+    // Sostituisco la più piccola e scendo
+    rollup_free(items[0]);
+    items[0] = r;
+    for (int i = 0;;) {
+        int min = i, l = 2 * i + 1, rr = 2 * i + 2;
+        if (l < top_n && items[l]->totals.bytes < items[min]->totals.bytes) min = l;
+        if (rr < top_n && items[rr]->totals.bytes < items[min]->totals.bytes) min = rr;
+        if (min == i) break;
+        heap_swap(items, i, min);
+        i = min;
+    }
+}
+
+/**
+ * Funzione per concludere la visita di una directory: somma le voci accumulate dal thread al
+ * suo Rollup e, se anche tutte le sottodirectory sono concluse, la riporta e risale verso la radice
+ * @param r: Rollup della directory visitata
+ */
+void rollup_finish(Rollup *r) {
+    pthread_mutex_lock(&r->lock);
+    totals_merge(&r->totals, &local_totals);
+    pthread_mutex_unlock(&r->lock);
+    local_totals.bytes = local_totals.blocks = local_totals.files = local_totals.dirs = 0;
+    local_totals.n_owners = 0;
+
+    // Chi porta unfinished a zero è l'ultimo a toccare r: nessun altro thread lo modificherà
+    while (r != NULL && atomic_fetch_sub(&r->unfinished, 1) == 1) {
+        Rollup *parent = r->parent;
+        if (parent != NULL) {
+            pthread_mutex_lock(&parent->lock);
+            totals_merge(&parent->totals, &r->totals);
+            pthread_mutex_unlock(&parent->lock);
+        }
+        if (parent == NULL) root_rollup = r;  // La radice viene stampata da main
+        else if (top_n > 0) top_offer(r);
+        else {
+            print_rollup(r);
+            rollup_free(r);
+        }
+        r = parent;
+    }
+}
+
+int compare_rollups(const void *a, const void *b) {
+    uint64_t x = (*(Rollup *const *)a)->totals.bytes, y = (*(Rollup *const *)b)->totals.bytes;
+    return (x < y) - (x > y);  // Ordine decrescente
+}
+
+/**
+ * Funzione per stampare, a visita conclusa, le top_n directory più grandi (radice compresa) e
+ * poi i totali della radice
+ */
+void print_aggregate(void) {
+    if (top_n > 0) {
+        int total = 1;
+        for (TopHeap *h = all_heaps; h != NULL; h = h->next) total += h->count;
+        Rollup **all = xmalloc(total * sizeof(Rollup *));
+        int n = 0;
+        for (TopHeap *h = all_heaps; h != NULL; h = h->next) {
+            memcpy(all + n, h->items, h->count * sizeof(Rollup *));
+            n += h->count;
+        }
+        all[n++] = root_rollup;
+        qsort(all, n, sizeof(Rollup *), compare_rollups);
+        for (int i = 0; i < n && i < top_n; i++) print_rollup(all[i]);
+        free(all);
+    } else {
+        print_rollup(root_rollup);
+    }
+}
+
+/**
+ * Funzione per garantire che fullpath contenga almeno len caratteri più il terminatore.
+ * Il contenuto precedente non viene conservato
+ */
+void fullpath_reserve(size_t len) {
+    if (len + 1 > fullpath_cap) {
+        fullpath_cap = (len + 1) * 2;
+        free(fullpath);
+        fullpath = xmalloc(fullpath_cap);
+    }
+}
+
+/**
+ * Funzione per gestire una voce di cui conosco il tipo o i metadati: la stampa e, se è una
+ * directory, la inserisce nella coda del thread
+ * @param dir: Directory che contiene la voce
+ * @param self: Coda del thread
+ * @param name: Nome della voce
+ * @param statbuf: Metadati della voce (con -n solo st_mode)
+ */
+void handle_entry(Dir *dir, Deque *self, const char *name, struct stat *statbuf) {
+    // Creo il percorso completo del file/directory, senza limiti di lunghezza
+    size_t name_len = strlen(name);
+    size_t len = dir->path_len + 1 + name_len;
+    fullpath_reserve(len);
+    memcpy(fullpath, dir->path, dir->path_len);
+    fullpath[dir->path_len] = '/';
+    memcpy(fullpath + dir->path_len + 1, name, name_len + 1);
+
+    // Stampo le informazioni del file/directory e le aggiungo al nuovo indice o ai totali
+    if (!diff_mode && !aggregate) print_info(fullpath, statbuf);
+    if (index_path != NULL) index_add(fullpath, len, statbuf);
+    if (aggregate && !S_ISDIR(statbuf->st_mode)) totals_add(&local_totals, statbuf);
+
+    // Se è una directory, la inserisco nella coda: verrà visitata da questo o da un altro thread
+    if (S_ISDIR(statbuf->st_mode)) {
+        Dir *child = xmalloc(sizeof(Dir));
+        child->parent = dir;
+        child->path = xmalloc(len + 1);
+        memcpy(child->path, fullpath, len + 1);
+        child->path_len = len;
+        child->name_off = dir->path_len + 1;
+        child->fd = -1;
+        child->reuse = dir_unchanged(fullpath, len, statbuf);
+        child->rollup = aggregate ? rollup_new(dir->rollup, fullpath, len, statbuf) : NULL;
+        atomic_init(&child->fd_users, 1);
+        atomic_fetch_add(&dir->fd_users, 1);  // Il figlio userà il nostro fd con openat
+        atomic_fetch_add(&pending, 1);
+        deque_push(self, child);
+    }
+}
+
+/**
+ * Funzione per ottenere i metadati di un blocco di voci lette con getdents64 e gestirle
+ * @param dir: Directory che contiene le voci
+ * @param self: Coda del thread
+ * @param names: Nomi delle voci
+ * @param types: d_type delle voci
+ * @param count: Numero di voci
+ */
+void handle_batch(Dir *dir, Deque *self, char **names, unsigned char *types, int count) {
+    struct stat statbuf;
+    struct statx stx;
+    for (int from = 0; from < count; from += RING_ENTRIES) {
+        int n = count - from < RING_ENTRIES ? count - from : RING_ENTRIES;
+        int use_ring = backend == BACKEND_URING && !names_only;
+        if (use_ring) ring_statx(&ring, dir->fd, names + from, n, ring_stx, ring_res);
+
+        for (int i = 0; i < n; i++) {
+            char *name = names[from + i];
+            int err = 0;
+            if (names_only && (statbuf.st_mode = dtype_to_mode(types[from + i])) != 0) {
+                // Con -n mi basta d_type; chiamo stat solo se il filesystem non lo fornisce
+            } else if (use_ring) {
+                err = ring_res[i];
+                statx_to_stat(&ring_stx[i], &statbuf);
+            } else if (backend == BACKEND_STAT) {
+                atomic_fetch_add(&count_stat, 1);
+                if (fstatat(dir->fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) err = -errno;
+            } else {
+                atomic_fetch_add(&count_stat, 1);
+                if (statx(dir->fd, name, AT_SYMLINK_NOFOLLOW, statx_mask, &stx) == -1) err = -errno;
+                else statx_to_stat(&stx, &statbuf);
+            }
+            if (err != 0) {
+                errno = -err;
+                perror(backend == BACKEND_STAT ? "fstatat" : "statx");
+                continue;
+            }
+            handle_entry(dir, self, name, &statbuf);
+        }
+    }
+}
+
+/**
+ * Funzione per visitare una directory invariata rispetto all'indice senza leggerla: le voci
+ * sono quelle dell'indice e solo le sottodirectory vengono riesaminate con stat, per sapere se
+ * a loro volta sono cambiate
+ * @param dir: Directory da visitare, già aperta
+ * @param self: Coda del thread corrente
+ */
+void reuse_directory(Dir *dir, Deque *self) {
+    atomic_fetch_add(&count_reused, 1);
+    // Con la chiave "<dir>/" (padre dir->path, nome "/") la ricerca trova il primo figlio
+    size_t prefix = dir->path_len + 1;
+    char *key = xmalloc(prefix);
+    memcpy(key, dir->path, dir->path_len);
+    key[dir->path_len] = '/';
+    uint64_t i = index_lower_bound(key, prefix);
 
-        // Creo il percorso completo del file/directory
-        char fullpath[1024];
-        snprintf(fullpath, sizeof(fullpath), "%s/%s", dirpath, entry->d_name);
+    char name[NAME_MAX + 1];
+    struct stat statbuf;
+    size_t used = 0;
+    int count = 0;
+    for (; i < old_count; i++) {
+        const IndexRecord *rec = &old_records[i];
+        const char *path = old_path(rec);
+        size_t name_len = rec->path_len - prefix;
+        if (rec->path_len <= prefix || memcmp(path, key, prefix) != 0 ||
+            memchr(path + prefix, '/', name_len) != NULL)
+            break;  // Fine dei figli diretti
+        if (name_len > NAME_MAX) continue;
 
-        // Ottengo le informazioni del file o directory con lstat
-        if (lstat(fullpath, &statbuf) == -1) {
-            perror("lstat");
+        if (!S_ISDIR(rec->mode)) {
+            memcpy(name, path + prefix, name_len);
+            name[name_len] = '\0';
+            record_to_stat(rec, &statbuf);
+            handle_entry(dir, self, name, &statbuf);
             continue;
         }
+        // Le sottodirectory passano da handle_batch come se fossero state lette con getdents64
+        if (used + name_len + 1 > DENTS_SIZE || count == DENTS_SIZE / 24) {
+            handle_batch(dir, self, names, types, count);
+            used = 0;
+            count = 0;
+        }
+        names[count] = dents + used;
+        types[count] = DT_DIR;
+        memcpy(dents + used, path + prefix, name_len);
+        dents[used + name_len] = '\0';
+        used += name_len + 1;
+        count++;
+    }
+    handle_batch(dir, self, names, types, count);
+    free(key);
+}
+
+/**
+ * Funzione per visitare una directory: la apre rispetto al padre, legge le voci con getdents64
+ * e le gestisce un blocco alla volta
+ * @param dir: Directory da visitare
+ * @param self: Coda del thread che esegue la visita
+ */
+void traverse_directory(Dir *dir, Deque *self) {
+    // Alla prima visita alloco i buffer del thread
+    if (dents == NULL) {
+        dents = xmalloc(DENTS_SIZE);
+        names = xmalloc(DENTS_SIZE / 24 * sizeof(char *));  // Una voce occupa almeno 24 byte
+        types = xmalloc(DENTS_SIZE / 24);
+        if (backend == BACKEND_URING) {
+            if (ring.sqes == NULL && ring_init(&ring) == -1) {
+                perror("io_uring_setup");
+                exit(1);
+            }
+            ring_stx = xmalloc(RING_ENTRIES * sizeof(struct statx));
+            ring_res = xmalloc(RING_ENTRIES * sizeof(int));
+        }
+    }
 
-        // Stampo le informazioni del file/directory
-        print_info(fullpath, &statbuf);
+    int parent_fd = dir->parent ? dir->parent->fd : AT_FDCWD;
+    atomic_fetch_add(&count_openat, 1);
+    dir->fd = openat(parent_fd, dir->path + dir->name_off, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dir->parent) release_dir(dir->parent);  // Il padre non serve più a questa directory
+    if (dir->fd == -1) {
+        // Gestisco gli errori nell'apertura della directory
+        perror("openat");
+        if (dir->rollup) rollup_finish(dir->rollup);
+        release_dir(dir);
+        return;
+    }
 
-        // Se è una directory, la attraversiamo ricorsivamente
-        if (S_ISDIR(statbuf.st_mode)) {
-            traverse_directory(fullpath);
+    if (dir->reuse) {
+        reuse_directory(dir, self);
+        release_dir(dir);
+        return;
+    }
+
+    // Ciclo attraverso tutte le voci della directory, un buffer di getdents64 alla volta
+    long nread;
+    while (1) {
+        atomic_fetch_add(&count_getdents, 1);
+        nread = syscall(SYS_getdents64, dir->fd, dents, DENTS_SIZE);
+        if (nread <= 0) break;
+
+        int count = 0;
+        for (long off = 0; off < nread;) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(dents + off);
+            off += entry->d_reclen;
+            // Ignoro le directory speciali "." e ".."
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+            names[count] = entry->d_name;
+            types[count] = entry->d_type;
+            count++;
         }
+        handle_batch(dir, self, names, types, count);
     }
+    if (nread == -1) perror("getdents64");
+    if (dir->rollup) rollup_finish(dir->rollup);
 
-    // Chiudo la directory dopo averla attraversata
-    closedir(dir);
+    // Rilascio la directory dopo averla attraversata
+    release_dir(dir);
+}
+
+/**
+ * Funzione eseguita da ogni thread: visita le directory della propria coda e, quando è
+ * vuota, ne ruba dalle code degli altri finché tutte le directory non sono state visitate
+ * @param arg: Indice del thread
+ * @return: NULL
+ */
+void *worker(void *arg) {
+    int id = (int)(long)arg;
+    Deque *self = &deques[id];
+    while (1) {
+        unsigned long epoch = atomic_load(&work_epoch);  // Letto prima di guardare le code
+        Dir *dir = deque_pop(self, 0);
+        for (int i = 1; dir == NULL && i < num_threads; i++) {
+            dir = deque_pop(&deques[(id + i) % num_threads], 1);  // Provo a rubare, a partire dal vicino
+        }
+        if (dir == NULL) {
+            // Altri thread stanno ancora visitando e possono produrre nuove directory: aspetto
+            // un inserimento o la fine della visita
+            pthread_mutex_lock(&idle_lock);
+            atomic_fetch_add(&idle_waiters, 1);
+            while (atomic_load(&pending) > 0 && atomic_load(&work_epoch) == epoch) {
+                pthread_cond_wait(&idle_cond, &idle_lock);
+            }
+            atomic_fetch_sub(&idle_waiters, 1);
+            pthread_mutex_unlock(&idle_lock);
+            if (atomic_load(&pending) == 0) break;  // Nessuna directory in coda né in visita: ho finito
+            continue;
+        }
+        traverse_directory(dir, self);
+        if (atomic_fetch_sub(&pending, 1) == 1) {
+            // Ultima directory: sveglio tutti i thread in attesa perché terminino
+            pthread_mutex_lock(&idle_lock);
+            pthread_cond_broadcast(&idle_cond);
+            pthread_mutex_unlock(&idle_lock);
+        }
+    }
+    flush_output();  // Scrivo le voci rimaste nel buffer del thread
+    return NULL;
 }
 
 /**
@@ -98,25 +1500,124 @@ void traverse_directory(const char *dirpath) {
  * @return: Codice di uscita
  */
 int main(int argc, char *argv[]) {
+    // Leggo le opzioni: -j numero di thread, -b backend per i metadati, -n solo nome e tipo,
+    // -s statistiche sulle system call, -o formato di output, -i indice, -d solo differenze,
+    // -a totali per directory, -t solo le directory più grandi
+    const char *usage = "Usage: %s [-j threads] [-b stat|statx|uring] [-n] [-s] [-o text|ndjson|binary] "
+                        "[-i index [-d]] [-a [-t count]] <directory>\n";
+    int opt;
+    while ((opt = getopt(argc, argv, "j:b:nso:i:dat:")) != -1) {
+        if (opt == 'j') {
+            num_threads = atoi(optarg);
+        } else if (opt == 'b' && strcmp(optarg, "stat") == 0) {
+            backend = BACKEND_STAT;
+        } else if (opt == 'b' && strcmp(optarg, "statx") == 0) {
+            backend = BACKEND_STATX;
+        } else if (opt == 'b' && strcmp(optarg, "uring") == 0) {
+            backend = BACKEND_URING;
+        } else if (opt == 'n') {
+            names_only = 1;
+        } else if (opt == 's') {
+            show_stats = 1;
+        } else if (opt == 'o' && strcmp(optarg, "text") == 0) {
+            output_format = FORMAT_TEXT;
+        } else if (opt == 'o' && strcmp(optarg, "ndjson") == 0) {
+            output_format = FORMAT_NDJSON;
+        } else if (opt == 'o' && strcmp(optarg, "binary") == 0) {
+            output_format = FORMAT_BINARY;
+        } else if (opt == 'i') {
+            index_path = optarg;
+        } else if (opt == 'd') {
+            diff_mode = 1;
+        } else if (opt == 'a') {
+            aggregate = 1;
+        } else if (opt == 't' && atoi(optarg) > 0) {
+            aggregate = 1;
+            top_n = atoi(optarg);
+        } else {
+            fprintf(stderr, usage, argv[0]);
+            return 1;
+        }
+    }
+
     // Verifico se è stato passato l'argomento corretto (percorso della directory)
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+    // L'indice e l'aggregazione hanno bisogno dei metadati completi, quindi non sono compatibili
+    // con -n; l'indice non conserva i blocchi allocati, quindi non si combina con -a
+    if (argc - optind != 1 || num_threads < 1 || num_threads > MAX_THREADS ||
+        (index_path != NULL && names_only) || (diff_mode && index_path == NULL) ||
+        (aggregate && (names_only || index_path != NULL || output_format == FORMAT_BINARY))) {
+        fprintf(stderr, usage, argv[0]);
         return 1;
     }
 
+    // Verifico subito che io_uring sia disponibile, altrimenti ripiego su statx.
+    // L'anello creato qui resta al thread principale, che partecipa alla visita
+    if (backend == BACKEND_URING && ring_init(&ring) == -1) {
+        perror("io_uring_setup");
+        fprintf(stderr, "io_uring not available, using statx\n");
+        backend = BACKEND_STATX;
+    }
+    char *root_path = argv[optind];
+    if (index_path != NULL) {
+        statx_mask |= STATX_MTIME | STATX_CTIME;
+        index_load();
+    }
+    if (aggregate) {
+        statx_mask |= STATX_NLINK | STATX_BLOCKS;
+        for (int i = 0; i < LINK_SHARDS; i++) pthread_mutex_init(&link_shards[i].lock, NULL);
+    }
+
     // Ottengo le informazioni del percorso specificato
     struct stat statbuf;
-    if (lstat(argv[1], &statbuf) == -1) {
+    if (lstat(root_path, &statbuf) == -1) {
         perror("lstat");
         return 1;
     }
 
     // Stampo le informazioni della directory/file iniziale
-    print_info(argv[1], &statbuf);
+    size_t root_len = strlen(root_path);
+    if (!diff_mode && !aggregate) print_info(root_path, &statbuf);
+    if (index_path != NULL) index_add(root_path, root_len, &statbuf);
+    Rollup *rollup = NULL;
+    if (aggregate) {
+        // La radice ha sempre un Rollup, anche se non è una directory
+        rollup = rollup_new(NULL, root_path, root_len, &statbuf);
+        if (!S_ISDIR(statbuf.st_mode)) rollup_finish(rollup);
+    }
 
-    // Se è una directory, la attraversiamo ricorsivamente
+    // Se è una directory, la attraversiamo con i thread
     if (S_ISDIR(statbuf.st_mode)) {
-        traverse_directory(argv[1]);
+        Dir *root = xmalloc(sizeof(Dir));
+        root->parent = NULL;
+        root->path_len = strlen(root_path);
+        root->path = xmalloc(root->path_len + 1);
+        memcpy(root->path, root_path, root->path_len + 1);
+        root->name_off = 0;  // La radice viene aperta con il percorso completo
+        root->fd = -1;
+        root->reuse = dir_unchanged(root_path, root_len, &statbuf);
+        root->rollup = rollup;
+        atomic_init(&root->fd_users, 1);
+
+        for (int i = 0; i < num_threads; i++) pthread_mutex_init(&deques[i].lock, NULL);
+        atomic_store(&pending, 1);
+        deque_push(&deques[0], root);
+
+        pthread_t threads[MAX_THREADS];
+        for (int i = 1; i < num_threads; i++) {
+            pthread_create(&threads[i], NULL, worker, (void *)(long)i);
+        }
+        worker((void *)0L);  // Il thread principale partecipa alla visita
+        for (int i = 1; i < num_threads; i++) pthread_join(threads[i], NULL);
+    }
+
+    if (aggregate) print_aggregate();
+    flush_output();
+    if (index_path != NULL) index_finish();
+    if (show_stats) {
+        fprintf(stderr, "Syscalls: openat %ld, getdents64 %ld, stat %ld, io_uring_enter %ld, total %ld\n",
+                count_openat, count_getdents, count_stat, count_uring_enter,
+                count_openat + count_getdents + count_stat + count_uring_enter);
+        if (index_path != NULL) fprintf(stderr, "Index: %ld directories reused\n", count_reused);
     }
 
     return 0;
@@ -0,0 +1,230 @@
+# Benchmark per parallel.c.
+# skew: esegue job con durate molto sbilanciate (un job lungo ogni <procs>, gli altri brevi)
+# e confronta il makespan di parallel.c con una distribuzione round-robin statica,
+# in cui ogni worker riceve in anticipo i job di indice i % procs.
+# rate: misura i job al secondo di un comando banale (di default "true %") eseguito con
+# posix_spawn (default) e attraverso la shell (--shell).
+# pressure: esegue parallel.c con --adaptive mentre genera, una fase dopo l'altra, carico
+# CPU e pressione sulla memoria, e stampa come varia il numero di job in esecuzione.
+# suite: esegue i carichi tiny (molti job banali), long (pochi job lunghi), skewed (durate
+# sbilanciate) e output (job che producono molto output) con concorrenza 1, 2, 4, ... fino al
+# numero di CPU, con parallel.c e, se installati, con xargs -P e GNU parallel. Per ogni
+# esecuzione scrive in CSV job/s, makespan, CPU usata dal solo processo padre e sua memoria
+# massima, così da confrontare revisioni diverse.
+#
+# Esempio di utilizzo:
+# ./parallel-bench.sh skew 4
+# ./parallel-bench.sh suite results.csv
+
+#!/bin/bash
+
+PARALLEL=${PARALLEL:-./parallel}
+WORKDIR=$(mktemp -d /tmp/parallel-bench-XXXXXX)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+# Tempo trascorso in secondi (con millisecondi) dall'istante passato come argomento
+elapsed() {
+    local start="$1"
+    local now=$(date +%s.%N)
+    awk -v a="$start" -v b="$now" 'BEGIN { printf "%.3f", b - a }'
+}
+
+# Genero gli argomenti: la durata di ogni job, lunga per i job di indice multiplo di procs
+skewed_args() {
+    local procs="$1"
+    local jobs="$2"
+    for ((i = 0; i < jobs; i++)); do
+        if ((i % procs == 0)); then
+            echo "0.5"
+        else
+            echo "0.01"
+        fi
+    done
+}
+
+# Round-robin statico: ogni worker esegue in sequenza i job assegnati, come faceva parallel.c
+round_robin() {
+    local args="$1"
+    local procs="$2"
+    local cmd="$3"
+    for ((w = 0; w < procs; w++)); do
+        awk -v p="$procs" -v w="$w" '(NR - 1) % p == w' "$args" | while read -r param; do
+            sh -c "${cmd//%/$param}"
+        done &
+    done
+    wait
+}
+
+skew() {
+    local procs="${1:-4}"
+    local jobs="${2:-$((procs * 8))}"
+    local args="$WORKDIR/skew.txt"
+    skewed_args "$procs" "$jobs" > "$args"
+
+    local start=$(date +%s.%N)
+    round_robin "$args" "$procs" "sleep %"
+    echo "round-robin: $(elapsed "$start") s"
+
+    start=$(date +%s.%N)
+    "$PARALLEL" "$args" "$procs" "sleep %" > /dev/null
+    echo "parallel:    $(elapsed "$start") s"
+}
+
+# Job al secondo dati il numero di job e il tempo trascorso
+rate_of() {
+    awk -v n="$1" -v t="$2" 'BEGIN { printf "%.0f", n / t }'
+}
+
+rate() {
+    local procs="${1:-4}"
+    local jobs="${2:-10000}"
+    local cmd="${3:-true %}"
+    local args="$WORKDIR/rate.txt"
+    seq "$jobs" > "$args"
+
+    local start=$(date +%s.%N)
+    "$PARALLEL" --shell "$args" "$procs" "$cmd" > /dev/null
+    local t=$(elapsed "$start")
+    echo "shell: $t s, $(rate_of "$jobs" "$t") jobs/s"
+
+    start=$(date +%s.%N)
+    "$PARALLEL" "$args" "$procs" "$cmd" > /dev/null
+    t=$(elapsed "$start")
+    echo "spawn: $t s, $(rate_of "$jobs" "$t") jobs/s"
+}
+
+# Carico CPU: due cicli infiniti per ogni CPU, terminati dopo $1 secondi
+cpu_hog() {
+    local secs="$1"
+    local pids=()
+    for ((c = 0; c < $(nproc) * 2; c++)); do
+        sh -c 'while :; do :; done' &
+        pids+=($!)
+    done
+    sleep "$secs"
+    kill "${pids[@]}"
+}
+
+# Pressione sulla memoria: tail tiene in memoria una riga senza newline grande quanto
+# quasi tutta la MemAvailable, lasciando libero circa il 5% della memoria totale
+mem_hog() {
+    local secs="$1"
+    local total=$(awk '/^MemTotal:/ { print $2 }' /proc/meminfo)
+    local avail=$(awk '/^MemAvailable:/ { print $2 }' /proc/meminfo)
+    local kb=$((avail - total / 20))
+    head -c "${kb}K" /dev/zero | tail > /dev/null &
+    local pid=$!
+    sleep "$secs"
+    kill "$pid" 2> /dev/null
+}
+
+pressure() {
+    local procs="${1:-$(($(nproc) * 2))}"
+    local phase="${2:-15}"
+    local start=$(date +%s.%N)
+
+    # Job brevi e infiniti: il numero di job in esecuzione dipende solo dal limite adattivo.
+    # stderr di parallel passa da una fifo, così ne conosco il pid e fermo solo quel processo
+    local fifo="$WORKDIR/pressure.fifo"
+    mkfifo "$fifo"
+    grep --line-buffered "^Slots:" < "$fifo" | while read -r line; do
+        echo "[$(elapsed "$start")] $line"
+    done &
+    local reader=$!
+    yes 0.2 | "$PARALLEL" -v --adaptive 1 - "$procs" "sleep %" 2> "$fifo" > /dev/null &
+    local runner=$!
+
+    echo "[$(elapsed "$start")] idle"
+    sleep "$phase"
+    echo "[$(elapsed "$start")] cpu pressure"
+    cpu_hog "$phase"
+    echo "[$(elapsed "$start")] idle"
+    sleep "$phase"
+    echo "[$(elapsed "$start")] memory pressure"
+    mem_hog "$phase"
+    echo "[$(elapsed "$start")] idle"
+    sleep "$phase"
+
+    kill "$runner"
+    wait "$runner" "$reader" 2> /dev/null
+}
+
+# Eseguo un comando in background e ne campiono /proc finché non termina, perché bash non
+# espone l'rusage di un singolo figlio. utime e stime in /proc/<pid>/stat escludono i figli,
+# quindi misurano solo il costo del processo che distribuisce i job; l'ultimo campione
+# precede l'uscita di al più un intervallo di campionamento.
+# Stampa "makespan cpu_secondi peak_rss_kb"
+measure() {
+    local start=$(date +%s.%N)
+    "$@" > /dev/null 2>&1 &
+    local pid=$!
+    local ticks=0 hwm=0 stat line
+    local hz=$(getconf CLK_TCK)
+    while kill -0 "$pid" 2> /dev/null; do
+        if read -r stat < "/proc/$pid/stat" 2> /dev/null; then
+            stat=${stat##*) }  # Il nome del comando può contenere spazi: lo salto
+            set -- $stat
+            ticks=$((${12} + ${13}))  # utime e stime sono i campi 14 e 15
+        fi
+        while read -r line; do
+            [[ $line == VmHWM:* ]] && set -- $line && hwm=$2
+        done < "/proc/$pid/status" 2> /dev/null
+        sleep 0.02
+    done
+    wait "$pid"
+    echo "$(elapsed "$start") $(awk -v t="$ticks" -v hz="$hz" 'BEGIN { printf "%.2f", t / hz }') $hwm"
+}
+
+# Preparo gli argomenti di un carico e stampo il comando da eseguire per ciascuno
+workload() {
+    local name="$1"
+    local args="$WORKDIR/$name.txt"
+    case "$name" in
+        tiny) seq 2000 > "$args"; echo "true" ;;
+        long) for ((i = 0; i < 8; i++)); do echo 1; done > "$args"; echo "sleep" ;;
+        skewed) skewed_args 8 64 > "$args"; echo "sleep" ;;
+        output) for ((i = 0; i < 16; i++)); do echo 1000000; done > "$args"; echo "seq" ;;
+    esac
+}
+
+suite() {
+    local csv="${1:-/dev/stdout}"
+    local ncpu=$(nproc)
+    local rev=$(git rev-parse --short HEAD 2> /dev/null || echo unknown)
+    local levels=()
+    for ((c = 1; c < ncpu; c *= 2)); do levels+=("$c"); done
+    levels+=("$ncpu")
+
+    local tools=(parallel.c)
+    command -v xargs > /dev/null && tools+=(xargs)
+    command -v parallel > /dev/null && parallel --version 2> /dev/null | grep -q GNU && tools+=(gnu-parallel)
+
+    echo "revision,tool,workload,concurrency,jobs,makespan_s,jobs_per_s,parent_cpu_s,peak_rss_kb" > "$csv"
+    for name in tiny long skewed output; do
+        local cmd=$(workload "$name")
+        local args="$WORKDIR/$name.txt"
+        local jobs=$(wc -l < "$args")
+        for c in "${levels[@]}"; do
+            for tool in "${tools[@]}"; do
+                local result
+                case "$tool" in
+                    parallel.c) result=$(measure "$PARALLEL" --group "$args" "$c" "$cmd %") ;;
+                    xargs) result=$(measure xargs -P "$c" -n 1 -a "$args" "$cmd") ;;
+                    gnu-parallel) result=$(measure parallel -j "$c" -a "$args" "$cmd") ;;
+                esac
+                set -- $result
+                echo "$rev,$tool,$name,$c,$jobs,$1,$(rate_of "$jobs" "$1"),$2,$3" >> "$csv"
+            done
+        done
+    done
+}
+
+case "$1" in
+    skew) skew "$2" "$3" ;;
+    rate) rate "$2" "$3" "$4" ;;
+    pressure) pressure "$2" "$3" ;;
+    suite) suite "$2" ;;
+    *)
+        echo "Usage: $0 {skew [procs] [jobs]|rate [procs] [jobs] [command]|pressure [max_procs] [phase_secs]|suite [csv]}"
+        ;;
+esac
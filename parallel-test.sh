@@ -0,0 +1,36 @@
+# Test per parallel.c.
+# stdin: con "-" i parametri arrivano dallo standard input; i job non devono ereditarlo, quindi
+# un comando che legge stdin (head -c 5) non deve consumare parametri. Controlla che nel joblog
+# ci sia una riga per ogni parametro e che l'output dei job sia vuoto.
+# Stampa "ok" o "FAIL" per ogni test ed esce con stato diverso da zero se un test fallisce.
+#
+# Esempio di utilizzo:
+# ./parallel-test.sh
+
+#!/bin/bash
+
+PARALLEL=${PARALLEL:-./parallel}
+WORKDIR=$(mktemp -d /tmp/parallel-test-XXXXXX)
+trap 'rm -rf "$WORKDIR"' EXIT
+FAILED=0
+
+check() {
+    local name="$1"
+    shift
+    if "$@"; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        FAILED=1
+    fi
+}
+
+stdin_not_inherited() {
+    local n=100000
+    local out=$(seq 1 "$n" | "$PARALLEL" --joblog "$WORKDIR/joblog" - 2 'head -c 5')
+    local rows=$(($(wc -l < "$WORKDIR/joblog") - 1))  # Tolgo l'intestazione
+    [ -z "$out" ] && [ "$rows" -eq "$n" ]
+}
+
+check stdin stdin_not_inherited
+exit $FAILED
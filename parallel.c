@@ -18,74 +18,811 @@ processi in parallelo. I comandi da eseguire saranno pertanto:
     ls /etc/hosts -lh
 */
 
+/*
+Estensioni rispetto al testo dell'esercizio:
+    - Il file dei parametri può avere righe di lunghezza qualsiasi; "-" indica lo standard input.
+    - Oltre a % il comando accetta i segnaposto {} (parametro), {.} (parametro senza
+      estensione) e {#} (numero progressivo del job).
+    - Senza --shell il comando viene diviso in parole ed eseguito con posix_spawn.
+    - Con --group l'output di ogni job viene stampato come un blocco unico, con --keep-order
+      anche nell'ordine dei parametri. --verbose stampa su stderr i messaggi di debug.
+    - Con --joblog <file> per ogni job vengono registrati tempi, CPU, memoria ed exit code;
+      --resume salta i job che nel joblog risultano già completati con successo.
+      --summary stampa su stderr latenze (p50, p95, p99) e throughput a fine esecuzione.
+    - Con --adaptive <min> il numero di job in esecuzione varia tra min e num_processes
+      in base a /proc/loadavg, MemAvailable e /proc/pressure; sopra la soglia --pressure
+      (percentuale di tempo in stallo "some", default 10) non vengono avviati nuovi job oltre min.
+*/
+
+#define _GNU_SOURCE  // Per splice
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <string.h>
 #include <errno.h>
+#include <getopt.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <time.h>
 
-// Definisco i limiti massimi per il numero di processi e la lunghezza di un comando
+// Definisco il limite massimo per il numero di processi
 #define MAXPROCESSES 256
-#define MAXCMD 256
+#define REORDER_FACTOR 4  // Con --keep-order al più REORDER_FACTOR job per figlio tra il primo non stampato e l'ultimo avviato
+#define CHUNK 65536       // Dimensione delle letture dalle pipe di output
+#define ADAPT_INTERVAL 1000  // Con --adaptive, millisecondi tra due misure del carico
+#define MEM_RESERVE 10.0     // Con --adaptive, percentuale minima di MemAvailable su MemTotal
+
+extern char **environ;
+
+// Buffer di lunghezza variabile, riutilizzato da un job all'altro
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+// Intestazione dei messaggi sulle pipe dei figli: precede len byte di parametro
+typedef struct {
+    uint64_t seq;  // Numero progressivo del job, a partire da 1
+    uint32_t len;  // Lunghezza del parametro
+} Frame;
+
+// Messaggio dal figlio al padre sulla pipe delle richieste: riporta il job appena finito
+// (seq 0 alla prima richiesta) e chiede il successivo. È più corto di PIPE_BUF, quindi
+// la write è atomica anche con molti figli
+typedef struct {
+    int worker;         // Indice del figlio
+    int status;         // Stato di uscita restituito da wait4
+    uint64_t seq;       // Job terminato, 0 se nessuno
+    double start;       // Istante di avvio (secondi dall'epoch)
+    double runtime;     // Durata in secondi
+    double utime;       // CPU utente in secondi
+    double stime;       // CPU di sistema in secondi
+    long maxrss;        // Massima memoria residente in KB
+} Result;
+
+// Funzione per garantire che il buffer possa contenere almeno need byte
+void buffer_reserve(Buffer *buf, size_t need) {
+    if (need <= buf->cap) return;
+    size_t cap = buf->cap ? buf->cap : 256;
+    while (cap < need) cap *= 2;  // Raddoppio la capacità per ammortizzare le realloc
+    char *data = realloc(buf->data, cap);
+    if (data == NULL) {
+        perror("Failed to allocate memory");
+        exit(EXIT_FAILURE);
+    }
+    buf->data = data;
+    buf->cap = cap;
+}
+
+// Funzione per accodare n byte al buffer
+void buffer_append(Buffer *buf, const char *src, size_t n) {
+    buffer_reserve(buf, buf->len + n + 1);
+    memcpy(buf->data + buf->len, src, n);
+    buf->len += n;
+}
+
+// Funzione per leggere esattamente n byte da fd; ritorna 0 su EOF prima del primo byte
+int read_full(int fd, void *dst, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = read(fd, (char *)dst + done, n - done);
+        if (r == 0 && done == 0) return 0;
+        if (r == 0) {
+            fprintf(stderr, "Truncated message on pipe\n");
+            exit(EXIT_FAILURE);
+        }
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to read from pipe");
+            exit(EXIT_FAILURE);
+        }
+        done += r;
+    }
+    return 1;
+}
+
+// Funzione per scrivere esattamente n byte su fd; un parametro lungo può richiedere più write
+void write_full(int fd, const void *src, size_t n) {
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = write(fd, (const char *)src + done, n - done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write");
+            exit(EXIT_FAILURE);
+        }
+        done += w;
+    }
+}
+
+// Funzione per sostituire i segnaposto del comando con il parametro, in una sola passata.
+// Il risultato viene accodato a out e terminato con '\0'.
+//    % e {}  -> parametro
+//    {.}     -> parametro senza estensione
+//    {#}     -> numero progressivo del job
+void expand(const char *command, const char *param, size_t param_len, uint64_t seq, Buffer *out) {
+    // Calcolo una volta sola la lunghezza del parametro senza estensione
+    size_t stem_len = param_len;
+    for (size_t k = param_len; k > 0 && param[k - 1] != '/'; k--) {
+        if (param[k - 1] == '.') {
+            stem_len = k - 1;
+            break;
+        }
+    }
+
+    const char *start = command;  // Inizio del testo ancora da copiare
+    const char *p = command;
+    while (*p != '\0') {
+        if (*p == '%') {
+            buffer_append(out, start, p - start);
+            buffer_append(out, param, param_len);
+            start = ++p;
+        } else if (p[0] == '{' && p[1] == '}') {
+            buffer_append(out, start, p - start);
+            buffer_append(out, param, param_len);
+            start = p += 2;
+        } else if (p[0] == '{' && p[1] == '.' && p[2] == '}') {
+            buffer_append(out, start, p - start);
+            buffer_append(out, param, stem_len);
+            start = p += 3;
+        } else if (p[0] == '{' && p[1] == '#' && p[2] == '}') {
+            char num[24];
+            int n = snprintf(num, sizeof(num), "%llu", (unsigned long long)seq);
+            buffer_append(out, start, p - start);
+            buffer_append(out, num, n);
+            start = p += 3;
+        } else {
+            p++;
+        }
+    }
+    buffer_append(out, start, p - start);
+    buffer_append(out, "", 1);  // Termino la stringa, il '\0' fa parte del buffer
+}
+
+// Funzione per dividere il comando in parole, una sola volta prima di creare i figli.
+// Le parole sono separate da spazi o tab; apici singoli e doppi raggruppano più parole.
+// Modifica command sul posto, riempie words (terminato da NULL) e ritorna il numero di parole
+int split_template(char *command, char **words) {
+    int count = 0;
+    char *src = command, *dst = command;
+    while (*src != '\0') {
+        while (*src == ' ' || *src == '\t') src++;  // Salto gli spazi iniziali
+        if (*src == '\0') break;
+        words[count++] = dst;
+        char quote = '\0';
+        while (*src != '\0' && (quote != '\0' || (*src != ' ' && *src != '\t'))) {
+            if (quote == '\0' && (*src == '\'' || *src == '"')) quote = *src;  // Apro un apice
+            else if (*src == quote) quote = '\0';  // Chiudo l'apice
+            else *dst++ = *src;
+            src++;
+        }
+        if (*src != '\0') src++;
+        *dst++ = '\0';  // Termino la parola (dst non supera mai src)
+    }
+    words[count] = NULL;
+    return count;
+}
+
+// Opzioni comuni a padre e figli
+int use_shell = 0;     // Esegue i comandi tramite /bin/sh
+int group_output = 0;  // Stampa l'output di ogni job come un blocco unico
+int keep_order = 0;    // Stampa i blocchi nell'ordine dei parametri
+int verbose = 0;       // Stampa i messaggi di debug su stderr
+
+// Funzione per eseguire un job attraverso la shell, come faceva la versione originale con
+// system(). Ritorna il pid del processo creato, -1 se non è stato possibile avviarlo
+pid_t run_shell(const char *command, const char *param, size_t param_len, uint64_t seq, Buffer *cmd) {
+    cmd->len = 0;
+    expand(command, param, param_len, seq, cmd);
+    if (verbose) fprintf(stderr, "Executing command: %s\n", cmd->data);  // Messaggio di debug
+
+    char *args[] = { "sh", "-c", cmd->data, NULL };
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", NULL, NULL, args, environ);
+    if (err != 0) {
+        fprintf(stderr, "/bin/sh: %s\n", strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+// Funzione per eseguire un job direttamente con posix_spawn, senza passare dalla shell:
+// espando le parole una dopo l'altra nello stesso buffer e creo un solo processo per job
+pid_t run_spawn(char **words, int nwords, const char *param, size_t param_len, uint64_t seq,
+                Buffer *cmd, size_t *offsets, char **args) {
+    cmd->len = 0;
+    for (int w = 0; w < nwords; w++) {
+        offsets[w] = cmd->len;
+        expand(words[w], param, param_len, seq, cmd);
+    }
+    // Calcolo i puntatori solo alla fine, perché le realloc possono spostare il buffer
+    for (int w = 0; w < nwords; w++) args[w] = cmd->data + offsets[w];
+    args[nwords] = NULL;
+
+    if (verbose) {  // Messaggio di debug, composto prima per stamparlo con una sola write
+        static Buffer msg = {0};
+        msg.len = 0;
+        buffer_append(&msg, "Executing command:", 18);
+        for (int w = 0; w < nwords; w++) {
+            buffer_append(&msg, " ", 1);
+            buffer_append(&msg, args[w], strlen(args[w]));
+        }
+        buffer_append(&msg, "\n", 1);
+        write_full(STDERR_FILENO, msg.data, msg.len);
+    }
+
+    pid_t pid;
+    int err = posix_spawnp(&pid, args[0], NULL, NULL, args, environ);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", args[0], strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+// Funzione per convertire una timespec o una timeval in secondi
+double ts_seconds(struct timespec ts) {
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double tv_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Stato dell'output di un job catturato dal padre
+typedef struct Job {
+    uint64_t order;  // Posizione del job tra quelli avviati, che con --resume può differire da seq
+    Buffer out;    // stdout ricevuto ma non ancora stampato
+    Buffer err;    // stderr, stampato sempre alla fine del job
+    struct Job *next;  // Job successivo nella coda dei job finiti
+} Job;
+
+// Stato del padre
+int num_workers;
+int pipes[MAXPROCESSES][2];      // Parametri dal padre al figlio i
+int out_pipes[MAXPROCESSES][2];  // stdout dei job del figlio i
+int err_pipes[MAXPROCESSES][2];  // stderr dei job del figlio i
+Job *running[MAXPROCESSES];      // Job in esecuzione su ciascun figlio
+int active;                      // Figli che non hanno ancora ricevuto EOF
+FILE *input;                     // File dei parametri
+int input_done = 0;              // Parametri finiti
+char *line = NULL;               // Riga letta dall'input, riutilizzata
+size_t line_cap = 0;
+uint64_t command_count = 0;      // Parametri letti finora, compresi quelli saltati da --resume
+uint64_t dispatched = 0;         // Job avviati finora
+int owner = -1;                  // Figlio il cui job scrive direttamente su stdout
+int use_splice = 1;              // Diventa 0 se stdout non supporta splice
+Job **reorder;                   // Con --keep-order, job finiti in attesa del proprio turno
+uint64_t window;                 // Dimensione di reorder
+uint64_t next_emit = 1;          // Primo job non ancora stampato
+Job *done_head = NULL;           // Con --group, job finiti mentre un altro job scrive su stdout
+Job *done_tail = NULL;
+int waiting[MAXPROCESSES];       // Figli liberi fermi perché reorder è pieno
+int nwaiting = 0;
+FILE *joblog = NULL;             // Con --joblog, file su cui registro i job finiti
+Buffer params[MAXPROCESSES];     // Con --joblog, parametro del job in esecuzione su ciascun figlio
+unsigned char *succeeded = NULL; // Con --resume, bitmap dei job già completati con successo
+uint64_t succeeded_max = 0;      // Numero di bit in succeeded
+double *runtimes = NULL;         // Durate dei job finiti, per il riepilogo
+uint64_t runtimes_len = 0, runtimes_cap = 0;
+uint64_t failed = 0;             // Job terminati con exit code diverso da 0 o per un segnale
+int busy = 0;                    // Figli con un job in esecuzione
+int adaptive = 0;                // Con --adaptive, i job in esecuzione variano tra min_slots e num_workers
+int min_slots, slots;            // Limite minimo e limite attuale dei job in esecuzione
+int holding = 0;                 // Pressione sopra soglia: non avvio job oltre min_slots
+double pressure_limit = 10.0;    // Soglia sulla percentuale di tempo in stallo delle PSI
+
+// Misure del carico della macchina usate da --adaptive
+typedef struct {
+    double load;      // Carico medio a 1 minuto diviso per il numero di CPU
+    double mem_free;  // Percentuale di MemAvailable su MemTotal
+    double psi[3];    // Percentuale di tempo in stallo "some" di /proc/pressure/{cpu,memory,io}
+                      // dall'ultima misura, -1 se non disponibile
+} Load;
+
+// Funzione per copiare su stdout tutto ciò che è disponibile su fd. Uso splice, che
+// sposta le pagine della pipe senza passare dallo spazio utente, e ripiego su read/write
+// se stdout non la supporta. Ritorna 0 quando la pipe è chiusa
+int copy_to_stdout(int fd) {
+    char chunk[CHUNK];
+    while (1) {
+        ssize_t n;
+        if (use_splice) {
+            n = splice(fd, NULL, STDOUT_FILENO, NULL, CHUNK, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINVAL) {
+                use_splice = 0;
+                continue;
+            }
+        } else {
+            n = read(fd, chunk, CHUNK);
+            if (n > 0) write_full(STDOUT_FILENO, chunk, n);
+        }
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return 1;  // Pipe vuota
+            perror("Failed to copy output");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Funzione per accodare a buf tutto ciò che è disponibile su fd. Ritorna 0 quando la pipe è chiusa
+int read_into(int fd, Buffer *buf) {
+    while (1) {
+        buffer_reserve(buf, buf->len + CHUNK);
+        ssize_t n = read(fd, buf->data + buf->len, CHUNK);
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return 1;  // Pipe vuota
+            perror("Failed to read output");
+            exit(EXIT_FAILURE);
+        }
+        buf->len += n;
+    }
+}
+
+// Funzione per scartare i dati disponibili su una pipe; ritorna 0 all'EOF
+int discard_pipe(int fd) {
+    char buf[CHUNK];
+    while (1) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return 1;
+            perror("Failed to read output");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Funzione per leggere l'output disponibile del job in esecuzione sul figlio w
+void drain_worker(int w) {
+    Job *job = running[w];
+    if (out_pipes[w][0] != -1) {
+        int open = owner == w ? copy_to_stdout(out_pipes[w][0]) : read_into(out_pipes[w][0], &job->out);
+        if (!open) {
+            close(out_pipes[w][0]);
+            out_pipes[w][0] = -1;
+        }
+    }
+    if (err_pipes[w][0] != -1 && !read_into(err_pipes[w][0], &job->err)) {
+        close(err_pipes[w][0]);
+        err_pipes[w][0] = -1;
+    }
+}
+
+// Funzione per dare al job del figlio w l'accesso diretto a stdout, dopo aver stampato
+// quanto ha già prodotto
+void take_stdout(int w) {
+    owner = w;
+    write_full(STDOUT_FILENO, running[w]->out.data, running[w]->out.len);
+    running[w]->out.len = 0;
+}
+
+// Funzione per stampare il blocco di output di un job e liberarlo
+void emit_job(Job *job) {
+    write_full(STDOUT_FILENO, job->out.data, job->out.len);
+    write_full(STDERR_FILENO, job->err.data, job->err.len);
+    free(job->out.data);
+    free(job->err.data);
+    free(job);
+}
+
+// Funzione per sapere se il job seq risulta già completato con successo nel joblog
+int already_done(uint64_t seq) {
+    return seq < succeeded_max && (succeeded[seq / 8] & (1 << (seq % 8)));
+}
+
+// Funzione per caricare da un joblog esistente i job completati con successo
+void load_joblog(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        if (errno == ENOENT) return;  // Nessuna esecuzione precedente
+        perror("Failed to open joblog");
+        exit(EXIT_FAILURE);
+    }
+    char *row = NULL;
+    size_t cap = 0;
+    while (getline(&row, &cap, file) != -1) {
+        unsigned long long seq;
+        int exitval, sig;
+        // Le righe che non iniziano con un numero (l'intestazione) vengono ignorate
+        if (sscanf(row, "%llu %*s %*s %*s %*s %*s %d %d", &seq, &exitval, &sig) != 3) continue;
+        if (exitval != 0 || sig != 0) continue;
+        if (seq >= succeeded_max) {
+            uint64_t bits = succeeded_max ? succeeded_max : 1024;
+            while (bits <= seq) bits *= 2;
+            succeeded = realloc(succeeded, bits / 8);
+            if (succeeded == NULL) {
+                perror("Failed to allocate memory");
+                exit(EXIT_FAILURE);
+            }
+            memset(succeeded + succeeded_max / 8, 0, (bits - succeeded_max) / 8);
+            succeeded_max = bits;
+        }
+        succeeded[seq / 8] |= 1 << (seq % 8);
+    }
+    free(row);
+    fclose(file);
+}
+
+// Funzione per registrare un job finito nel joblog e nelle statistiche
+void record_result(const Result *res) {
+    int exitval = WIFEXITED(res->status) ? WEXITSTATUS(res->status) : 0;
+    int sig = WIFSIGNALED(res->status) ? WTERMSIG(res->status) : 0;
+    if (exitval != 0 || sig != 0) failed++;
+
+    if (runtimes_len == runtimes_cap) {
+        runtimes_cap = runtimes_cap ? runtimes_cap * 2 : 1024;
+        runtimes = realloc(runtimes, runtimes_cap * sizeof(double));
+        if (runtimes == NULL) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+    }
+    runtimes[runtimes_len++] = res->runtime;
 
-// Funzione per chiudere tutte le estremità di scrittura delle pipe
-void close_pipes(int pipes[MAXPROCESSES][2], int n) {
-    for (int i = 0; i < n; i++) {
-        close(pipes[i][1]);  // Chiudo l'estremità di scrittura della pipe
+    if (joblog != NULL) {
+        fprintf(joblog, "%llu\t%.3f\t%.3f\t%.3f\t%.3f\t%ld\t%d\t%d\t%s\n",
+                (unsigned long long)res->seq, res->start, res->runtime, res->utime, res->stime,
+                res->maxrss, exitval, sig, params[res->worker].data);
+        fflush(joblog);  // Ogni riga arriva subito sul file, così --resume funziona anche dopo un crash
     }
 }
 
-// Funzione per sostituire il carattere '%' nel comando con il parametro
-void replace_percent(char *command, char *param, char *result) {
-    char *pos = strstr(command, "%");  // Trovo la posizione del carattere '%'
-    if (pos == NULL) {  // Se non trovo '%', copio il comando così com'è
-        strcpy(result, command);
+int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Funzione per stampare il riepilogo dell'esecuzione: percentili delle durate e throughput
+void print_summary(double elapsed) {
+    fprintf(stderr, "Jobs: %llu, failed: %llu, elapsed: %.3f s, throughput: %.1f jobs/s\n",
+            (unsigned long long)runtimes_len, (unsigned long long)failed, elapsed,
+            elapsed > 0 ? runtimes_len / elapsed : 0.0);
+    if (runtimes_len == 0) return;
+    qsort(runtimes, runtimes_len, sizeof(double), compare_double);
+    double pct[] = { 50, 95, 99 };
+    fprintf(stderr, "Latency:");
+    for (int k = 0; k < 3; k++) {
+        uint64_t rank = (uint64_t)(pct[k] / 100 * runtimes_len + 0.999999);  // Metodo nearest-rank
+        if (rank == 0) rank = 1;
+        fprintf(stderr, " p%.0f %.3f s", pct[k], runtimes[rank - 1]);
+    }
+    fprintf(stderr, ", max %.3f s\n", runtimes[runtimes_len - 1]);
+}
+
+// Funzione per inviare il prossimo parametro al figlio w. Se i parametri sono finiti
+// chiudo la sua pipe, così il figlio riceve EOF e termina
+void dispatch(int w) {
+    ssize_t len = -1;
+    if (!input_done) {
+        // Cerco il prossimo parametro non vuoto
+        while ((len = getline(&line, &line_cap, input)) != -1) {
+            if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';  // Rimuovo il carattere di newline
+            if (len == 0) continue;  // Salto le linee vuote
+            if (!already_done(command_count + 1)) break;
+            command_count++;  // Con --resume il job è già stato eseguito: conservo solo la numerazione
+        }
+    }
+
+    if (len == -1) {
+        input_done = 1;
+        close(pipes[w][1]);
+        active--;
         return;
     }
-    // Copio la parte del comando prima di '%'
-    strncpy(result, command, pos - command);
-    result[pos - command] = '\0';  // Aggiungo il terminatore di stringa
-    strcat(result, param);  // Aggiungo il parametro
-    strcat(result, pos + 1);  // Aggiungo la parte del comando dopo '%'
+    if ((size_t)len > UINT32_MAX) {
+        fprintf(stderr, "Parameter is too long\n");
+        exit(EXIT_FAILURE);
+    }
+
+    command_count++;  // Incremento il conteggio dei comandi
+    busy++;
+    if (joblog != NULL) {
+        params[w].len = 0;
+        buffer_append(&params[w], line, len + 1);
+    }
+    if (group_output) {
+        running[w] = calloc(1, sizeof(Job));
+        if (running[w] == NULL) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        running[w]->order = ++dispatched;
+        if (keep_order && dispatched == next_emit) owner = w;  // Il primo job in ordine scrive subito
+    }
+
+    if (verbose) fprintf(stderr, "Sending parameter to process %d: %s\n", w, line);  // Messaggio di debug
+    Frame frame = { .seq = command_count, .len = (uint32_t)len };
+    write_full(pipes[w][1], &frame, sizeof(frame));
+    write_full(pipes[w][1], line, len);
+}
+
+// Funzione per assegnare un job a un figlio libero, rispettando il limite di reorder
+void request_job(int w) {
+    if (keep_order && !input_done && dispatched + 1 >= next_emit + window) {
+        waiting[nwaiting++] = w;  // Riprenderà quando i job più vecchi saranno stampati
+        return;
+    }
+    if (adaptive && !input_done && (busy >= slots || (holding && busy >= min_slots))) {
+        waiting[nwaiting++] = w;  // Riprenderà quando il limite di job salirà
+        return;
+    }
+    dispatch(w);
+}
+
+// Funzione per riprendere i figli fermi, che tornano in attesa se il limite non lo consente
+void resume_waiting() {
+    int n = nwaiting;
+    nwaiting = 0;
+    for (int k = 0; k < n; k++) request_job(waiting[k]);
+}
+
+// Funzione per calcolare da un file di /proc/pressure la percentuale di tempo in stallo
+// dall'ultima misura. Uso il contatore cumulativo total (in microsecondi) invece di avg10,
+// che è una media su 10 secondi e reagirebbe troppo lentamente. -1 se non disponibile
+double read_psi(const char *path, unsigned long long *last_total, double *last_time) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return -1;
+    unsigned long long total;
+    int ok = fscanf(file, "some avg10=%*f avg60=%*f avg300=%*f total=%llu", &total) == 1;
+    fclose(file);
+    if (!ok) return -1;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    double now = ts_seconds(ts);
+    double pct = 0;
+    if (*last_time > 0 && now > *last_time) pct = (total - *last_total) / 1e4 / (now - *last_time);
+    *last_total = total;
+    *last_time = now;
+    return pct;
+}
+
+// Funzione per misurare il carico attuale della macchina
+void sample_load(Load *l) {
+    l->load = 0;
+    FILE *file = fopen("/proc/loadavg", "r");
+    if (file != NULL) {
+        if (fscanf(file, "%lf", &l->load) != 1) l->load = 0;
+        fclose(file);
+    }
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    l->load /= ncpu > 0 ? ncpu : 1;
+
+    l->mem_free = 100;
+    file = fopen("/proc/meminfo", "r");
+    if (file != NULL) {
+        char key[64];
+        long value, total = 0, avail = -1;
+        while (fscanf(file, "%63s %ld kB", key, &value) == 2) {
+            if (strcmp(key, "MemTotal:") == 0) total = value;
+            else if (strcmp(key, "MemAvailable:") == 0) avail = value;
+        }
+        fclose(file);
+        if (total > 0 && avail >= 0) l->mem_free = 100.0 * avail / total;
+    }
+
+    static const char *psi_files[3] = { "/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io" };
+    static unsigned long long psi_total[3];
+    static double psi_time[3];
+    for (int k = 0; k < 3; k++) l->psi[k] = read_psi(psi_files[k], &psi_total[k], &psi_time[k]);
+}
+
+// Funzione per aggiornare il limite dei job in esecuzione: scendo di uno quando la macchina è
+// sotto pressione e salgo di uno quando ha margine, così il limite non oscilla a ogni misura
+void adapt_slots() {
+    Load l;
+    sample_load(&l);
+    double psi = 0;
+    for (int k = 0; k < 3; k++) if (l.psi[k] > psi) psi = l.psi[k];
+
+    int old = slots;
+    holding = psi > pressure_limit || l.mem_free < MEM_RESERVE;
+    if (holding || l.load > 1.5) {
+        if (slots > min_slots) slots--;
+    } else if (l.load < 1.0 && psi < pressure_limit / 2) {
+        if (slots < num_workers) slots++;
+    }
+
+    if (verbose && (slots != old || holding)) {
+        fprintf(stderr, "Slots: %d%s (load %.2f, mem available %.0f%%, psi cpu %.1f memory %.1f io %.1f)\n",
+                slots, holding ? " holding" : "", l.load, l.mem_free, l.psi[0], l.psi[1], l.psi[2]);
+    }
+    if (slots > old || !holding) resume_waiting();
+}
+
+// Funzione per stampare, con --keep-order, tutti i job pronti a partire da next_emit
+void advance() {
+    Job *job;
+    while ((job = reorder[next_emit % window]) != NULL) {
+        reorder[next_emit % window] = NULL;
+        emit_job(job);
+        next_emit++;
+    }
+    // Se il nuovo primo job è ancora in esecuzione, gli passo stdout
+    for (int w = 0; w < num_workers; w++) {
+        if (running[w] != NULL && running[w]->order == next_emit) {
+            take_stdout(w);
+            break;
+        }
+    }
+    // Ora che reorder ha spazio, riprendo i figli fermi
+    resume_waiting();
+}
+
+// Funzione chiamata quando il figlio w ha finito il suo job
+void job_finished(int w) {
+    Job *job = running[w];
+    drain_worker(w);  // Il job è terminato, quindi tutto il suo output è già nelle pipe
+    running[w] = NULL;
+
+    if (!keep_order) {
+        if (owner != -1 && owner != w) {
+            // Un altro job sta scrivendo su stdout: stampo questo blocco quando avrà finito
+            if (done_tail != NULL) done_tail->next = job;
+            else done_head = job;
+            done_tail = job;
+            return;
+        }
+        owner = -1;
+        emit_job(job);
+        while (done_head != NULL) {  // Stampo i job finiti nel frattempo
+            job = done_head;
+            done_head = job->next;
+            emit_job(job);
+        }
+        done_tail = NULL;
+    } else if (job->order == next_emit) {
+        owner = -1;
+        emit_job(job);
+        next_emit++;
+        advance();
+    } else {
+        reorder[job->order % window] = job;
+    }
 }
 
 int main(int argc, char *argv[]) {
+    // Leggo le opzioni: --shell esegue i comandi tramite /bin/sh invece di posix_spawn
+    static struct option long_options[] = {
+        {"shell", no_argument, NULL, 's'},
+        {"group", no_argument, NULL, 'g'},
+        {"keep-order", no_argument, NULL, 'k'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"joblog", required_argument, NULL, 'j'},
+        {"resume", no_argument, NULL, 'r'},
+        {"summary", no_argument, NULL, 'S'},
+        {"adaptive", required_argument, NULL, 'a'},
+        {"pressure", required_argument, NULL, 'p'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *usage = "Usage: %s [--shell] [-g|--group] [-k|--keep-order] [-v|--verbose]\n"
+                        "       [--joblog <file> [--resume]] [--summary] [--adaptive <min> [--pressure <pct>]]\n"
+                        "       <file|-> <num_processes> <command>\n";
+    char *joblog_path = NULL;
+    int resume = 0, summary = 0;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+gkv", long_options, NULL)) != -1) {
+        if (opt == 's') {
+            use_shell = 1;
+        } else if (opt == 'g') {
+            group_output = 1;
+        } else if (opt == 'k') {
+            keep_order = group_output = 1;  // --keep-order implica --group
+        } else if (opt == 'v') {
+            verbose = 1;
+        } else if (opt == 'j') {
+            joblog_path = optarg;
+        } else if (opt == 'r') {
+            resume = 1;
+        } else if (opt == 'S') {
+            summary = 1;
+        } else if (opt == 'a') {
+            adaptive = 1;
+            min_slots = atoi(optarg);
+        } else if (opt == 'p') {
+            pressure_limit = atof(optarg);
+        } else {
+            fprintf(stderr, usage, argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // Controllo che il numero di argomenti sia corretto
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <file> <num_processes> <command>\n", argv[0]);
+    if (argc - optind != 3 || (resume && joblog_path == NULL)) {
+        fprintf(stderr, usage, argv[0]);
         exit(EXIT_FAILURE);
     }
 
     // Estraggo il nome del file e il numero di processi
-    char *filename = argv[1];
+    char *filename = argv[optind];
     char *endptr;
     errno = 0;  // Resetto errno prima della chiamata a strtol
-    long num_processes = strtol(argv[2], &endptr, 10);  // Converto il numero di processi
+    long num_processes = strtol(argv[optind + 1], &endptr, 10);  // Converto il numero di processi
 
     // Controllo se ci sono stati errori nella conversione
     if (errno != 0 || *endptr != '\0' || num_processes <= 0 || num_processes > MAXPROCESSES) {
         fprintf(stderr, "Invalid number of processes. Must be between 1 and %d\n", MAXPROCESSES);
         exit(EXIT_FAILURE);
     }
+    num_workers = num_processes;
+    if (adaptive && (min_slots <= 0 || min_slots > num_workers)) {
+        fprintf(stderr, "Invalid minimum for --adaptive. Must be between 1 and %d\n", num_workers);
+        exit(EXIT_FAILURE);
+    }
+    slots = min_slots;  // Con --adaptive parto dal minimo e salgo se la macchina ha margine
 
-    char *command = argv[3];  // Estraggo il comando da eseguire
+    char *command = argv[optind + 2];  // Estraggo il comando da eseguire
 
-    // Apro il file contenente i parametri dei comandi
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
+    // Senza --shell divido il comando in parole una volta sola, prima di creare i figli
+    char *template = NULL;
+    char **words = NULL;
+    int nwords = 0;
+    if (!use_shell) {
+        template = strdup(command);
+        words = malloc((strlen(command) / 2 + 2) * sizeof(char *));  // Al più una parola ogni due caratteri
+        if (template == NULL || words == NULL) {
+            perror("Failed to allocate memory");
+            exit(EXIT_FAILURE);
+        }
+        nwords = split_template(template, words);
+        if (nwords == 0) {
+            fprintf(stderr, "Invalid command: empty command\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Apro il file contenente i parametri dei comandi ("-" indica lo standard input)
+    input = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (input == NULL) {
         perror("Failed to open file");  // Stampo un messaggio di errore se non riesco ad aprire il file
         exit(EXIT_FAILURE);
     }
 
-    // Creo le pipe per la comunicazione tra il processo padre e i processi figli
-    int pipes[MAXPROCESSES][2];
+    // Con --resume leggo i job già completati, poi apro il joblog in aggiunta; altrimenti lo riscrivo
+    if (joblog_path != NULL) {
+        if (resume) load_joblog(joblog_path);
+        joblog = fopen(joblog_path, resume ? "a" : "w");
+        if (joblog == NULL) {
+            perror("Failed to open joblog");
+            exit(EXIT_FAILURE);
+        }
+        if (ftell(joblog) == 0) {
+            fprintf(joblog, "Seq\tStarttime\tJobRuntime\tUserCPU\tSysCPU\tMaxRSS\tExitval\tSignal\tParam\n");
+        }
+        fflush(joblog);  // Svuoto il buffer prima di fork, altrimenti ogni figlio lo riscriverebbe
+    }
+    struct timespec run_start, run_end;
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+
+    // Creo le pipe per la comunicazione tra il processo padre e i processi figli:
+    // pipes[i] porta i parametri dal padre al figlio i, mentre ready è condivisa da
+    // tutti i figli, che vi scrivono il proprio indice quando sono liberi.
+    // Con --group creo anche le pipe da cui il padre legge stdout e stderr dei job.
+    int ready[2];
     for (int i = 0; i < num_processes; i++) {
-        if (pipe(pipes[i]) == -1) {
+        out_pipes[i][0] = out_pipes[i][1] = err_pipes[i][0] = err_pipes[i][1] = -1;
+        if (pipe(pipes[i]) == -1 ||
+            (group_output && (pipe2(out_pipes[i], O_CLOEXEC) == -1 || pipe2(err_pipes[i], O_CLOEXEC) == -1))) {
             perror("Failed to create pipe");  // Stampo un messaggio di errore se non riesco a creare una pipe
             exit(EXIT_FAILURE);
         }
     }
+    if (pipe(ready) == -1) {
+        perror("Failed to create pipe");
+        exit(EXIT_FAILURE);
+    }
 
     // Creo i processi figli usando fork()
     pid_t pids[MAXPROCESSES];
@@ -95,65 +832,180 @@ int main(int argc, char *argv[]) {
             perror("Failed to fork");  // Stampo un messaggio di errore se fork() fallisce
             exit(EXIT_FAILURE);
         } else if (pids[i] == 0) {  // Questo blocco di codice viene eseguito dai processi figli
-            close(pipes[i][1]);  // Chiudo l'estremità di scrittura della pipe nel processo figlio
+            // Chiudo le estremità di scrittura di tutte le pipe dei comandi e quelle di
+            // lettura degli altri figli: altrimenti nessun figlio riceverebbe mai EOF
+            for (int j = 0; j < num_processes; j++) {
+                close(pipes[j][1]);
+                if (j != i) close(pipes[j][0]);
+            }
+            close(ready[0]);  // Il figlio scrive soltanto sulla pipe delle richieste
+            if (input != stdin) {
+                fclose(input);
+            } else {
+                // I parametri arrivano dallo standard input: i job non devono ereditarlo, o un
+                // comando che legge stdin consumerebbe righe non ancora distribuite
+                int null_fd = open("/dev/null", O_RDONLY);
+                if (null_fd == -1 || dup2(null_fd, STDIN_FILENO) == -1) {
+                    perror("Failed to open /dev/null");
+                    exit(EXIT_FAILURE);
+                }
+                close(null_fd);
+            }
+
+            // Con --group i job scrivono sulle pipe lette dal padre; dup2 toglie O_CLOEXEC
+            if (group_output) {
+                dup2(out_pipes[i][1], STDOUT_FILENO);
+                dup2(err_pipes[i][1], STDERR_FILENO);
+            }
 
-            char cmd[MAXCMD];
+            // Buffer riutilizzati da tutti i job del figlio
+            Buffer param = {0}, cmd = {0};
+            size_t *offsets = malloc((nwords + 1) * sizeof(size_t));
+            char **args = malloc((nwords + 1) * sizeof(char *));
+            Frame frame;
+            Result res = { .worker = i };
             while (1) {
-                int bytesRead = read(pipes[i][0], cmd, MAXCMD);
-                if (bytesRead == 0) break;  // Se non ci sono più dati da leggere, esco dal ciclo
-                if (bytesRead < 0) {  // Se c'è un errore nella lettura, stampo un messaggio di errore e esco
-                    perror("Failed to read from pipe");
-                    exit(EXIT_FAILURE);
+                // Riporto il job precedente e chiedo un nuovo parametro al padre
+                write_full(ready[1], &res, sizeof(res));
+                if (!read_full(pipes[i][0], &frame, sizeof(frame))) break;  // EOF: non ci sono più parametri
+
+                buffer_reserve(&param, frame.len + 1);
+                read_full(pipes[i][0], param.data, frame.len);
+                param.data[frame.len] = '\0';  // Assicuro che la stringa letta sia null-terminata
+
+                struct timespec start, t0, t1;
+                clock_gettime(CLOCK_REALTIME, &start);
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                pid_t pid;
+                if (use_shell) {
+                    pid = run_shell(command, param.data, frame.len, frame.seq, &cmd);
+                } else {
+                    pid = run_spawn(words, nwords, param.data, frame.len, frame.seq, &cmd, offsets, args);
                 }
-                cmd[bytesRead] = '\0';  // Assicuro che la stringa letta sia null-terminata
-                printf("Executing command: %s\n", cmd);  // Messaggio di debug
-                system(cmd);  // Eseguo il comando letto dalla pipe
+
+                // Attendo la fine del job raccogliendo exit code e risorse usate
+                struct rusage ru = {0};
+                res.status = 127 << 8;  // Come la shell quando il comando non si avvia
+                if (pid != -1) {
+                    while (wait4(pid, &res.status, 0, &ru) == -1 && errno == EINTR);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+
+                res.seq = frame.seq;
+                res.start = ts_seconds(start);
+                res.runtime = ts_seconds(t1) - ts_seconds(t0);
+                res.utime = tv_seconds(ru.ru_utime);
+                res.stime = tv_seconds(ru.ru_stime);
+                res.maxrss = ru.ru_maxrss;
             }
 
             close(pipes[i][0]);  // Chiudo l'estremità di lettura della pipe
+            close(ready[1]);
             exit(EXIT_SUCCESS);  // Termino il processo figlio dopo aver eseguito tutti i comandi
         } else {  // Questo blocco di codice viene eseguito dal processo padre
             close(pipes[i][0]);  // Chiudo l'estremità di lettura della pipe nel processo padre
         }
     }
+    close(ready[1]);  // Il padre legge soltanto le richieste dei figli
 
-    // Leggo i parametri dal file e li invio ai processi figli attraverso le pipe
-    char param[MAXCMD];
-    int command_count = 0;
-    while (fgets(param, MAXCMD, file) != NULL) {
-        param[strcspn(param, "\n")] = '\0';  // Rimuovo il carattere di newline dai parametri letti
+    // Registro su epoll la pipe delle richieste e, con --group, le pipe di output dei figli.
+    // Nel campo data metto 2 * i per lo stdout del figlio i e 2 * i + 1 per il suo stderr
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == -1) {
+        perror("Failed to create epoll instance");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = UINT32_MAX };
+    fcntl(ready[0], F_SETFL, O_NONBLOCK);
+    epoll_ctl(epfd, EPOLL_CTL_ADD, ready[0], &ev);
+    for (int i = 0; i < num_processes && group_output; i++) {
+        close(out_pipes[i][1]);
+        close(err_pipes[i][1]);
+        fcntl(out_pipes[i][0], F_SETFL, O_NONBLOCK);
+        fcntl(err_pipes[i][0], F_SETFL, O_NONBLOCK);
+        ev.data.u32 = 2 * i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, out_pipes[i][0], &ev);
+        ev.data.u32 = 2 * i + 1;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, err_pipes[i][0], &ev);
+    }
+    if (keep_order) {
+        window = REORDER_FACTOR * num_processes;
+        reorder = calloc(window, sizeof(Job *));
+    }
 
-        if (param[0] == '\0') {
-            continue;  // Salto le linee vuote
+    // Distribuisco i parametri su richiesta: ogni figlio riceve il parametro successivo
+    // solo quando ha finito il precedente, così un job lento non blocca quelli in coda.
+    // Leggo una riga dall'input solo quando un figlio è libero: la memoria usata resta
+    // costante anche con milioni di righe, e un input lento non viene letto in anticipo.
+    active = num_processes;
+    struct epoll_event events[64];
+    struct timespec last_sample = run_start, now;
+    while (active > 0) {
+        // Con --adaptive mi risveglio anche senza eventi per misurare il carico
+        int n = epoll_wait(epfd, events, 64, adaptive ? ADAPT_INTERVAL : -1);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (adaptive && ts_seconds(now) - ts_seconds(last_sample) >= ADAPT_INTERVAL / 1000.0) {
+            adapt_slots();
+            last_sample = now;
         }
-
-        char full_command[MAXCMD];
-        replace_percent(command, param, full_command);  // Sostituisco '%' con il parametro
-
-        if (strlen(full_command) >= MAXCMD) {
-            fprintf(stderr, "Command is too long\n");  // Stampo un messaggio di errore se il comando è troppo lungo
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("Failed to wait for events");
             exit(EXIT_FAILURE);
         }
+        for (int e = 0; e < n; e++) {
+            uint32_t id = events[e].data.u32;
+            if (id != UINT32_MAX) {
+                int w = id / 2;
+                if (running[w] == NULL) {
+                    // Nessun job in corso: scarto quello che arriva (un processo rimasto in background
+                    // può scrivere tardi) e chiudo la pipe solo all'EOF del figlio che termina
+                    int *fd = id % 2 == 0 ? &out_pipes[w][0] : &err_pipes[w][0];
+                    if (*fd != -1 && !discard_pipe(*fd)) { close(*fd); *fd = -1; }
+                    continue;
+                }
+                if (!keep_order && owner == -1 && id % 2 == 0) take_stdout(w);  // Con --group il primo che scrive prende stdout
+                drain_worker(w);
+                continue;
+            }
 
-        int target_process = command_count % num_processes;  // Determino quale figlio deve eseguire il comando corrente
-        printf("Sending command to process %d: %s\n", target_process, full_command);  // Messaggio di debug
-        if (write(pipes[target_process][1], full_command, strlen(full_command) + 1) == -1) {
-            perror("Failed to write to pipe");  // Stampo un messaggio di errore se non riesco a scrivere nella pipe
-            exit(EXIT_FAILURE);
+            // Leggo le richieste arrivate: ogni richiesta riporta il job appena finito dal figlio
+            Result results[32];
+            ssize_t r;
+            while ((r = read(ready[0], results, sizeof(results))) > 0) {
+                for (size_t k = 0; k < r / sizeof(Result); k++) {
+                    int w = results[k].worker;
+                    if (results[k].seq != 0) {
+                        record_result(&results[k]);
+                        busy--;
+                    }
+                    if (running[w] != NULL) job_finished(w);
+                    request_job(w);
+                }
+            }
+            if (r == 0) active = 0;  // Tutti i figli sono terminati
+            else if (errno != EAGAIN && errno != EINTR) {
+                perror("Failed to read from pipe");
+                exit(EXIT_FAILURE);
+            }
         }
-
-        command_count++;  // Incremento il conteggio dei comandi
+        // A parametri finiti i figli fermi devono solo ricevere EOF
+        if (input_done && nwaiting > 0) resume_waiting();
     }
 
-    fclose(file);  // Chiudo il file
-
-    // Chiudo tutte le estremità di scrittura delle pipe per segnalare ai figli che non ci sono più comandi da eseguire
-    close_pipes(pipes, num_processes);
+    free(line);
+    if (input != stdin) fclose(input);  // Chiudo il file
+    close(ready[0]);
+    close(epfd);
 
     // Attendo la terminazione di tutti i processi figli
     for (int i = 0; i < num_processes; i++) {
         wait(NULL);  // Il processo padre aspetta che ogni figlio termini
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &run_end);
+    if (joblog != NULL) fclose(joblog);
+    if (summary) print_summary(ts_seconds(run_end) - ts_seconds(run_start));
+
     return 0;  // Termino il programma con successo
 }